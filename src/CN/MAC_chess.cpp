@@ -37,8 +37,13 @@
 #include <algorithm>
 #include <random>
 #include <fstream>
+#include <optional>
 
 #include "chesstest.hpp"
+#include "cost_model.hpp"
+#include "sharded_map.hpp"
+#include "single_flight.hpp"
+#include "work_pool.hpp"
 
 #define APP_OCTET_LIM (MAX_NDN_PACKET_SIZE - 400)
 
@@ -61,57 +66,39 @@ namespace ndn {
 // Additional nested namespaces can be used to prevent/limit name conflicts
 namespace examples {
 
-// binary semaphore class: waiting for a currently operating thread for a specific matrix to finish so another thread can use the results from the reuse table
-class binary_sem {
-    public:
-        binary_sem() : flag_(true) {}
-    
-        void wait() {
-            std::unique_lock<std::mutex> lk(m_);
-            cv_.wait(lk, [=]{
-                return flag_;
-            });
-            flag_ = false;
-        }
-
-        bool try_wait() {
-            std::lock_guard<std::mutex> lk(m_);
-            if (flag_) {
-                flag_ = false;
-                return true;
-            } else
-                return false;
-        }
-
-        void signal() {
-            std::lock_guard<std::mutex> lk(m_);
-            flag_ = true;
-            cv_.notify_all();
-            flag_ = true;
-        }
-    
-    private:
-        bool flag_;
-        std::mutex m_;
-        std::condition_variable cv_;
-}; 
+// everything cached for one position
+struct fen_entry {
+    // guards moves
+    std::mutex m;
+    // maps depth -> countermove
+    std::map<int, std::string> moves;
+};
 
 // client handler data structure - each client has one
 struct client_handler {
     bool wait_to_grab;
     std::mutex m;
     std::string content;
-    bool tready;
+    // result of the finished task, set by its completion callback
+    std::optional<std::string> result;
     int iteration;
     std::string fen;
-    std::thread work;
+    // when the current task was requested and how long after that we expect its result to be ready (ms)
+    time::steady_clock::time_point requested;
+    double expected;
 
-    client_handler() : wait_to_grab(false), tready(false), iteration(0) {}
+    client_handler() : wait_to_grab(false), iteration(0), expected(0) {}
+};
+
+// what a leading search hands to the requests that followed its flight
+struct flight_result {
+    int depth;
+    std::string move;
 };
 
 class Producer : noncopyable {
     public:
-        Producer(double pnfm, bool uc) : non_first_frac(pnfm), use_cache(uc) {}
+        Producer(double pnfm, bool uc) : non_first_frac(pnfm), use_cache(uc), compute_cost(3, true) {}
 
         void run() {
             // setup interest filter for computation requests
@@ -124,7 +111,7 @@ class Producer : noncopyable {
 
     private:
 
-      void optimalMove(int ri, int depth) {
+      std::string optimalMove(int ri, int depth) {
           std::cout << "start thread" << std::endl;
           // uncomment following to log cpu in timestamps.dat
 //          {
@@ -135,51 +122,46 @@ class Producer : noncopyable {
 //          }
           // save a reference to minimize operator[] calls
           client_handler &chr = ch[ri];
+          time::steady_clock::time_point began = time::steady_clock::now();
           // check if we enabled reuse
           if (use_cache) {
-              std::shared_lock<std::shared_timed_mutex> slock(re_m);
               // check to see if FEN exists in reuse table
-              if (reuse_table.find(chr.fen) == reuse_table.end()) {
-                  // FEN does not exist
-                  // there are still possiblestarts to fill in the reuse_table
-                  if (reuse_table.size() < goldfish::ChessTest::possiblestarts.size()) {
-                      slock.unlock();
-                      // check if FEN is among the possiblestarts
-                      if (std::find(goldfish::ChessTest::possiblestarts.cbegin(), goldfish::ChessTest::possiblestarts.cend(), chr.fen) != goldfish::ChessTest::possiblestarts.cend()) {
-                          // it is, so we save it in the reuse table
-                          std::lock_guard<std::shared_timed_mutex> slock(re_m);
-                          reuse_table.emplace(std::piecewise_construct, std::forward_as_tuple(chr.fen), std::make_tuple());
-                      } else {
-                          // it is not a possiblestart
-                          static std::random_device rd;
-                          static std::mt19937 gen(rd());
-                          static std::uniform_int_distribution<> dis(1, 100);
-                          // we save non_first_frac percent of non-possiblestarts via RNG
-                          if (dis(gen) <= non_first_frac * 100) {
-                              std::lock_guard<std::shared_timed_mutex> slock(re_m);
-                              reuse_table.emplace(std::piecewise_construct, std::forward_as_tuple(chr.fen), std::make_tuple());
-                          }
-                      }
-                  }
-              } else {
-                  // FEN is in the reuse table already!
-                  slock.unlock();
-                  // we're not currently_operating anymore, so signal the waiting threads (if any)
-                  currently_operating[chr.fen].signal();
-                  {
-                      std::lock_guard<std::mutex> map_lock(map_m);
-                      currently_operating.erase(chr.fen);
-                  }
-                  std::cout << "signaled" << std::endl;
-                  std::lock_guard<std::mutex> locker(chr.m);
-                  slock.lock();
-                  // finally set the content to the result
-                  chr.content = reuse_table[chr.fen][depth];
-                  slock.unlock();
-                  // thread is finished, set the ready flag
-                  chr.tready = true;
+              std::optional<std::shared_ptr<fen_entry> > found = reuse_table.find(chr.fen);
+              std::optional<std::string> move;
+              if (found) {
+                  std::lock_guard<std::mutex> lock((*found)->m);
+                  auto it = (*found)->moves.find(depth);
+                  if (it != (*found)->moves.end())
+                      move = it->second;
+              }
+              if (move) {
+                  // FEN (searched to this depth) is in the reuse table already!
+                  compute_cost.observe(moveFeatures(depth, true), msSince(began));
                   std::cout << "end thread" << std::endl;
-                  return;
+                  // finally return the result
+                  return *move;
+              }
+              // FEN does not exist; if there are still possiblestarts to fill in the reuse_table, decide whether to keep it
+              // (a FEN that is in the table but was searched to another depth just gets this depth added below)
+              if (!found && reuse_table.size() < goldfish::ChessTest::possiblestarts.size()) {
+                  bool keep;
+                  // check if FEN is among the possiblestarts
+                  if (std::find(goldfish::ChessTest::possiblestarts.cbegin(), goldfish::ChessTest::possiblestarts.cend(), chr.fen) != goldfish::ChessTest::possiblestarts.cend())
+                      // it is, so we save it in the reuse table
+                      keep = true;
+                  else {
+                      // it is not a possiblestart
+                      static std::random_device rd;
+                      static std::mt19937 gen(rd());
+                      static std::uniform_int_distribution<> dis(1, 100);
+                      static std::mutex gen_m;
+                      // we save non_first_frac percent of non-possiblestarts via RNG
+                      std::lock_guard<std::mutex> lock(gen_m);
+                      keep = dis(gen) <= non_first_frac * 100;
+                  }
+                  if (keep)
+                      // inserting takes the FEN's shard exclusively; if someone beat us to it, theirs is kept
+                      reuse_table.insert(chr.fen, std::make_shared<fen_entry>());
               }
           }
 
@@ -188,28 +170,18 @@ class Producer : noncopyable {
           engine.receive_position(chr.fen);
           engine.receive_go(depth);
           engine.receive_quit(true);
+          compute_cost.observe(moveFeatures(depth, false), msSince(began));
           // check if enabled reuse
           if (use_cache) {
-              // it is enabled, so save the result in the table
-              std::shared_lock<std::shared_timed_mutex> slock(re_m);
-              if (reuse_table.find(chr.fen) != reuse_table.end())
-                  reuse_table[chr.fen].emplace(depth, engine.receive_response());
+              // it is enabled, so save the result in the table (if we decided to keep this FEN)
+              std::optional<std::shared_ptr<fen_entry> > found = reuse_table.find(chr.fen);
+              if (found) {
+                  std::string move(engine.receive_response());
+                  std::lock_guard<std::mutex> lock((*found)->m);
+                  (*found)->moves.emplace(depth, std::move(move));
+              }
           }
 
-          // we're not currently_operating anymore, so signal the waiting threads (if any)
-          currently_operating[chr.fen].signal();
-          {
-              std::lock_guard<std::mutex> map_lock(map_m);
-              currently_operating.erase(chr.fen);
-          }
-          std::cout << "signaled" << std::endl;
-          // finally set the content to the result
-          {
-              std::lock_guard<std::mutex> locker(chr.m);
-              chr.content = engine.receive_response();
-              // thread is finished, set the ready flag
-              chr.tready = true;
-          }
           std::cout << "end thread" << std::endl;
           // uncomment following to log cpu in timestamps.dat
 //          {
@@ -218,11 +190,84 @@ class Producer : noncopyable {
 //              log << "endcomp, ri: " << ri << " depth: " << depth << ' ' << std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count() << std::endl;
 //              //
 //          }
+          // finally return the result
+          return engine.receive_response();
+      }
+
+      // hands a move search to the worker pool; its completion callback stores the result for the next poll
+      // a search leading the flight for its FEN lands it, completing every request that followed it
+      // a failed search becomes an error result, so the callback runs (and the flight lands) whatever happens
+      void submitMove(int ri, int depth, bool lead) {
+          std::string fen(ch[ri].fen);
+          pool.submit([=]() -> std::string {
+              try {
+                  return optimalMove(ri, depth);
+              } catch (const std::exception &e) {
+                  std::cerr << "search for ri " << ri << " failed: " << e.what() << std::endl;
+                  return std::string("Error: ") + e.what();
+              }
+          }, [=](const std::string &result){
+              complete(ri, result);
+              if (lead)
+                  flights.finish(fen, flight_result{depth, result});
+          });
       }
 
-      // CTT estimation function
+      // stores the result of a search for the next poll
+      void complete(int ri, const std::string &result) {
+          client_handler &chr = ch[ri];
+          {
+              std::lock_guard<std::mutex> locker(chr.m);
+              chr.result = result;
+          }
+          // the result is ready, so let the requester know instead of leaving it to its next poll
+          notifyDone(ri);
+      }
+
+      // the flight a request followed has landed (on the leader's worker); r is null if it landed before we could follow it
+      void onFlightLanded(int ri, int depth, const flight_result *r) {
+          std::cout << "flight landed for ri " << ri << std::endl;
+          if (r && r->depth == depth)
+              // same position, same depth: the leader's move is ours
+              complete(ri, r->move);
+          else
+              // the position is in the table now (if it was kept), so this search is a lookup or at least starts warm
+              submitMove(ri, depth, false);
+      }
+
+      // tells the requester that its result is ready so it can fetch it right away instead of sleeping out the CTT
+      // best effort: if this Interest is lost the requester still polls, so timeouts and Nacks are only logged
+      void notifyDone(int ri) {
+          Interest done(Name("/edge-compute/requester/" + std::to_string(ri) + "/done").appendVersion());
+          done.setInterestLifetime(1_s);
+          done.setMustBeFresh(true);
+          // lock mutex to make sure no one else is sending while we are
+          std::lock_guard<std::mutex> lock(face_m);
+          m_face.expressInterest(done,
+                                 [](const Interest &, const Data &){},
+                                 [](const Interest &i, const lp::Nack &nack){
+                                     std::cerr << "received Nack with reason " << nack.getReason() << " for interest " << i << std::endl;
+                                 },
+                                 [](const Interest &i){
+                                     std::cerr << "Timeout " << i << std::endl;
+                                 });
+      }
+
+      // cost model features of a move search: the search tree grows exponentially with depth, so the model is fitted on
+      // the log of the duration, and a reuse hit scales it down by a learned factor
+      static std::vector<double> moveFeatures(int depth, bool hit) {
+          return {1.0, static_cast<double>(depth), hit ? 1.0 : 0.0};
+      }
+
+      // CTT estimation function: whatever is left of the expected completion time, and the old backoff curve once that
+      // has run out (or before the cost model has seen enough searches to predict anything)
       int estimateTime(int ri) {
-          return log(++ch[ri].iteration * 50.0) / log(1.005) - 750.0;
+          client_handler &chr = ch[ri];
+          double remaining = chr.expected - msSince(chr.requested);
+          ++chr.iteration;
+          if (remaining >= 1)
+              return std::ceil(remaining);
+          return log(chr.iteration * 50.0) / log(1.005) - 750.0;
       }
 
       void onInterest(const InterestFilter& filter, const Interest& interest) {
@@ -268,32 +313,33 @@ class Producer : noncopyable {
                       // when encoding names, spaces turned into %20's, so now we need to replace them with the spaces
                       boost::replace_all(chr.fen, "%20", " ");
                       // if enabling reuse,
-                      if (use_cache) {
-                          std::lock_guard<std::mutex> map_lock(map_m);
-                          // check to see if someone else is currently_operating on the FEN
-                          if (currently_operating.find(chr.fen) == currently_operating.end()) {
-                              // there isn't anyone currently_operating; create an entry in the currently_operating table, because now we operating on it
-                              currently_operating.emplace(std::piecewise_construct, std::forward_as_tuple(chr.fen), std::make_tuple());
-                              // lock/increment semaphore to show that we are operating
-                              currently_operating[chr.fen].wait();
-                          } else
-                              // there is somebody currently_operating on this matrix, so we wait to grab the results
-                              chr.wait_to_grab = true;
+                      if (use_cache)
+                          // lead the flight for this FEN, unless somebody is already searching it; then we follow theirs
+                          chr.wait_to_grab = !flights.lead(chr.fen);
+                      // expected completion: waiting for a worker, then the search (or the table lookup, if someone already searched this position)
+                      bool hit = chr.wait_to_grab;
+                      if (use_cache && !hit) {
+                          std::optional<std::shared_ptr<fen_entry> > found = reuse_table.find(chr.fen);
+                          if (found) {
+                              std::lock_guard<std::mutex> lock((*found)->m);
+                              hit = (*found)->moves.count(depth);
+                          }
                       }
                       // lock the mutex to make sure nobody changes content while we are setting the CTT
                       locker.lock();
+                      chr.requested = time::steady_clock::now();
+                      chr.expected = queueWait(pool, compute_cost.mean()) + compute_cost.predict(moveFeatures(depth, hit), 0);
                       chr.content = "CTT: " + std::to_string(estimateTime(requesterid));
                   } else {
                       // lock the mutex to make sure nobody changes content while we are settingthe result
                       locker.lock();
-                      if (!chr.tready) {
-                          // the thread is not done, so set the CTT
+                      if (!chr.result) {
+                          // the task is not done, so set the CTT
                           chr.content = "CTT: " + std::to_string(estimateTime(requesterid));
                       } else {
-                          // the thread is done, the result is already set in content, so join the thread, reset some variables
-                          if (chr.work.joinable())
-                              chr.work.join();
-                          chr.tready = false;
+                          // the task is done, hand out its result and reset some variables
+                          chr.content = std::move(*chr.result);
+                          chr.result.reset();
                           chr.iteration = 0;
                       }
                   }
@@ -314,22 +360,29 @@ class Producer : noncopyable {
           // Return Data packet to the requester
           std::cout << "content: " << chr.content << std::endl;
           std::cout << "sending data " << *data << std::endl;
-          m_face.put(*data);
+          {
+              // lock mutex to make sure no one else is sending while we are
+              std::lock_guard<std::mutex> lock(face_m);
+              m_face.put(*data);
+          }
 
           if (chr.iteration == 1) {
               // first interest, there's some stuff to do
-              if (chr.wait_to_grab) {
-                  // we decided earlier that someone is currently operating on the FEN, so we wait
-                  chr.work = std::thread([&]{
-                      // wait for the guy who's currently_operating to finish and notify us
-                      currently_operating[chr.fen].wait();
-                      std::cout << "done waiting" << std::endl;
-                      // NOW we can execute this task because we know it's in the table
-                      optimalMove(requesterid, depth);
+              bool follow = chr.wait_to_grab;
+              if (follow)
+                  // we decided earlier that someone is currently searching the FEN, so we follow its flight
+                  // no thread waits for it: the leader completes us when it lands
+                  follow = flights.follow(chr.fen, [=](const flight_result &r){
+                      onFlightLanded(requesterid, depth, &r);
                   });
-              } else
-                  // we shouldn't wait because nobody is operating on this FEN right now
-                  chr.work = std::thread(&Producer::optimalMove, this, requesterid, depth);
+              if (follow)
+                  std::cout << "following the flight for " << chr.fen << std::endl;
+              else if (chr.wait_to_grab)
+                  // it landed in the meantime
+                  onFlightLanded(requesterid, depth, nullptr);
+              else
+                  // nobody is searching this FEN right now, so we lead (with reuse enabled)
+                  submitMove(requesterid, depth, use_cache);
           }
           std::cout << "end onInterest" << std::endl;
       }
@@ -343,14 +396,18 @@ class Producer : noncopyable {
     
     private:
         Face m_face;
+        std::mutex face_m;
         double non_first_frac;
         bool use_cache;
+        // measured cost of a move search (see moveFeatures)
+        cost_model compute_cost;
         std::map<int, client_handler> ch;
-        // maps hash of FEN -> (depth -> countermove)
-        std::unordered_map<std::string, std::map<int, std::string> > reuse_table;
-        std::shared_timed_mutex re_m;
-        std::map<std::string, binary_sem> currently_operating;
-        std::mutex map_m;
+        // maps FEN -> its entry (depth -> countermove); sharded, so lookups of different positions never contend
+        sharded_map<std::string, std::shared_ptr<fen_entry> > reuse_table;
+        // requests for a FEN that is already being searched follow the leading search instead of starting their own
+        single_flight<std::string, flight_result> flights;
+        // declared last so the workers are joined before anything they use is torn down
+        work_pool pool;
 };
 
 } // namespace examples
@@ -45,6 +45,28 @@
 #include <cstring>
 #include <iterator>
 #include <queue>
+#include <map>
+#include <optional>
+#include <atomic>
+#include <functional>
+#include <tuple>
+
+#include "power_plan.hpp"
+#include "cost_model.hpp"
+#include "int_gemm.hpp"
+#include "matrix_canon.hpp"
+#include "matrix_chain.hpp"
+#include "matrix_wire.hpp"
+#include "reuse_store.hpp"
+#include "reuse_tiers.hpp"
+#include "segment_fetcher.hpp"
+#include "sharded_map.hpp"
+#include "sparse_power.hpp"
+#include "speculation.hpp"
+#include "single_flight.hpp"
+#include "store_writer.hpp"
+#include "tile_cache.hpp"
+#include "work_pool.hpp"
 
 #define APP_OCTET_LIM (MAX_NDN_PACKET_SIZE - 400)
 
@@ -67,52 +89,56 @@ namespace ndn {
 // Additional nested namespaces can be used to prevent/limit name conflicts
 namespace examples {
 
-// binary semaphore class: waiting for a currently operating thread for a specific matrix to finish so another thread can use the results from the reuse table
-class binary_sem {
-    public:
-        binary_sem() : flag_(true) {}
-    
-        void wait() {
-            std::unique_lock<std::mutex> lk(m_);
-            cv_.wait(lk, [=]{
-                return flag_;
-            });
-            flag_ = false;
-        }
-
-        bool try_wait() {
-            std::lock_guard<std::mutex> lk(m_);
-            if (flag_) {
-                flag_ = false;
-                return true;
-            } else
-                return false;
-        }
-
-        void signal() {
-            std::lock_guard<std::mutex> lk(m_);
-            flag_ = true;
-            cv_.notify_all();
-            flag_ = true;
-        }
-    
-    private:
-        bool flag_;
-        std::mutex m_;
-        std::condition_variable cv_;
-}; 
+// everything cached for one matrix, shared by all of its exponents
+struct reuse_entry {
+    matrix_digest digest;
+    // rows, and columns (the same for every matrix but the subproducts of a matrix chain)
+    int dim;
+    int cols;
+    // guards exps, store and used; only ever held for a few map operations, never across disk I/O
+    std::mutex m;
+    // last time a task used the matrix, for eviction
+    time::steady_clock::time_point used;
+    // maps exponent -> payload offset in the store
+    std::map<int, std::size_t> exps;
+    // binary store holding the matrix (exponent 1) and its cached powers
+    // null for entries loaded from the index at startup until findEntry has checked them against the store
+    std::shared_ptr<matrix_store> store;
+};
 
 // reuse table data structure for matrix
 struct reusable_table {
-    // maps hash of matrix string representations -> (exponent, byte offsets)
-    std::unordered_multimap<std::string, std::pair<std::size_t, std::size_t> > umm;
-    // maps hash of matrix string representations -> (byte offset intermediate values)
-    std::unordered_map<std::string, std::size_t> byte_offsets;
-    // mutex for the accessing the table
-    std::shared_timed_mutex re_m;
-
-    std::queue<std::thread> cachers;
-    std::mutex q_m;
+    // maps content digest of a matrix -> its entry
+    // sharded, so lookups of different matrices never contend and nothing waits behind a cacher writing to disk
+    sharded_map<matrix_digest, std::shared_ptr<reuse_entry>, digest_hash> entries;
+    // journal of every block appended to a store, replayed at startup (only with reuse enabled)
+    std::unique_ptr<reuse_index> index;
+    // hottest powers, decoded in memory (only with reuse enabled)
+    std::unique_ptr<ram_tier> ram;
+    tier_stats stats;
+    // serializes evicting a store with starting a fresh one, so an eviction never unlinks a store that replaced its victim
+    std::mutex evict_m;
+    // set while a disk eviction pass runs, so concurrent publishes don't start another
+    std::atomic<bool> evicting{false};
+    // writes the powers tasks computed to their stores in the background (only with reuse enabled)
+    // declared last so it is flushed and gone before anything its completions touch (index, tiers, stats) is torn down
+    std::unique_ptr<store_writer> writer;
+};
+
+// a matrix chain a requester asked for (see matrix_chain.hpp)
+struct chain_task {
+    // p0..pn, operand k is dims[k] x dims[k + 1]
+    std::vector<int> dims;
+    std::vector<matrix_digest> operands;
+    // multiplication order, given what the reuse table had when the request came in
+    chain_plan plan;
+    // cached operands and subproducts the plan starts from, (i, j) -> entry; held so eviction can't pull them away
+    std::map<std::pair<int, int>, std::shared_ptr<reuse_entry> > cached;
+    // positions of the operands to fetch from the requester (one per digest), and what arrived, by digest
+    std::vector<int> missing;
+    std::map<matrix_digest, Eigen::MatrixXi> fetched;
+    // fetched operands a segment of failed to decode (so some of their rows are zeros)
+    std::set<matrix_digest> corrupt;
 };
 
 // client handler data structure - each client has one
@@ -120,22 +146,55 @@ struct client_handler {
     bool wait_to_grab;
     std::mutex m;
     std::string content;
-    bool tready;
+    // result of the finished task, set by its completion callback
+    std::optional<std::string> result;
     int iteration;
     Eigen::MatrixXi mat;
     int counter;
     int numinter;
-    std::thread work;
-    std::unordered_multimap<std::string, std::pair<std::size_t, std::size_t> >::iterator mat_tableid;
+    // how the requester's matrix relates to the canonical one it sends (and we key the table by), from the Interest name
+    canonical_params canon;
+    // chain requests only
+    chain_task chain;
+    // reuse table entry of the requested matrix, if onInterest found its digest in the table
+    std::shared_ptr<reuse_entry> entry;
+    // fetch of the matrix parts, if we had to ask the client for them
+    std::shared_ptr<segment_fetcher> fetcher;
+    // when the current task was requested and how long after that we expect its result to be ready (ms)
+    time::steady_clock::time_point requested;
+    double expected;
 
-    client_handler() = default;
-    client_handler(const std::unordered_multimap<std::string, std::pair<std::size_t, std::size_t> >::iterator &it) : wait_to_grab(false), tready(false), iteration(0), counter(0), mat_tableid(it) {}
+    client_handler() : wait_to_grab(false), iteration(0), counter(0), expected(0) {}
+};
+
+// what a leading task hands to the requests that followed its flight
+struct flight_result {
+    int exponent;
+    std::string result;
+};
+
+// a request waiting to be taken along by the next chain on its matrix
+struct rider {
+    int ri;
+    int exponent;
+    // set by whichever takes the rider first: a leader's chain or the continuation of the flight it follows
+    std::shared_ptr<std::atomic<bool> > taken;
 };
 
 class Producer : noncopyable {
     public:
-        Producer(bool uc) : m_face(m_ioService), m_scheduler(m_ioService), use_cache(uc) {
+        Producer(bool uc, const fetch_options &fo, const persist_options &po, const checkpoint_policy &cp, const tier_options &to, const sparse_options &so, const tile_options &tl,
+                 const speculation_options &sp, gemm_backend gb)
+            : m_face(m_ioService), m_scheduler(m_ioService), use_cache(uc), fetch(fo), checkpoint(cp), tiers(to), sparse(so), tile(tl), tiles(tl.bytes),
+              spec(sp), demand(sp), speculating(false), request_tasks(0), started(time::steady_clock::now()), gemm(gb, &pool), compute_cost(3), transfer_cost(2) {
             mkdir("reusables", S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH);
+            if (use_cache) {
+                loadIndex();
+                reuse_table.writer.reset(new store_writer(reuse_table.index.get(), po));
+                reuse_table.ram.reset(new ram_tier(tiers.ram_bytes));
+            }
+            if (gb != gemm_backend::eigen)
+                std::cout << "blocked matrix kernel compiled for " << gemmIsa() << std::endl;
         }
 
         void run() {
@@ -144,30 +203,342 @@ class Producer : noncopyable {
                                      bind(&Producer::onInterest, this, _1, _2),
                                      RegisterPrefixSuccessCallback(),
                                      bind(&Producer::onRegisterFailed, this, _1, _2));
+            if (use_cache)
+                m_scheduler.scheduleEvent(tiers.report_interval, [this]{
+                    reportTiers();
+                });
+            if (use_cache && spec.interval > time::milliseconds::zero())
+                m_scheduler.scheduleEvent(spec.interval, [this]{
+                    considerSpeculation();
+                });
             m_face.processEvents();
         }
 
     private:
-      // auxiliary function for converting a Eigen::IOFormat-ted string into a Eigen::MatrixXi
-      Eigen::MatrixXi strtoMatrix(const std::string &s, int dimension) {
-          Eigen::MatrixXi res(dimension, dimension);
-          for (std::size_t index = 0, count = 0; index != s.size(); index = s.find("|", index) + 1, count++) {
-              std::vector<int> rowv;
-              rowv.reserve(dimension);
-              std::string srow(s.substr(index, s.find("|", index) - index + 1));
-              std::size_t pos;
-              std::size_t tot = 0;
-              std::size_t *next = &pos;
-              while (tot < srow.size()) {
-                  rowv.push_back(std::stoi(srow.substr(tot), next));
-                  tot += pos + 1;
+      static std::string storePath(const matrix_digest &digest) {
+          return "reusables/" + digestToHex(digest) + ".bin";
+      }
+
+      // warm restart: rebuilds the reuse table from the index journal without touching the stores themselves
+      // (they are opened and checked lazily by findEntry), so even tens of thousands of cached matrices load in milliseconds
+      void loadIndex() {
+          time::steady_clock::time_point began = time::steady_clock::now();
+          reuse_table.index.reset(new reuse_index("reusables/index.bin"));
+          std::size_t records = 0;
+          // nobody else runs yet, so collect the entries first and publish them once the journal is replayed
+          std::unordered_map<matrix_digest, std::shared_ptr<reuse_entry>, digest_hash> loaded;
+          reuse_table.index->replay([&](const index_record &r){
+              std::shared_ptr<reuse_entry> &entry = loaded[r.digest];
+              // an exponent 1 record means the store was started over
+              records++;
+              // an exponent 0 record means the store was evicted
+              if (r.exponent == 0) {
+                  loaded.erase(r.digest);
+                  return;
+              }
+              if (!entry || r.exponent == 1 || entry->dim != static_cast<int>(r.rows) || entry->cols != static_cast<int>(r.cols)) {
+                  entry = std::make_shared<reuse_entry>();
+                  entry->digest = r.digest;
+                  entry->dim = r.rows;
+                  entry->cols = r.cols;
+                  entry->used = began;
+              }
+              entry->exps[r.exponent] = r.offset;
+          });
+          for (auto &e : loaded) {
+              reuse_table.stats.disk_bytes += storeBytes(e.second->dim, e.second->cols, e.second->exps.size());
+              reuse_table.entries.assign(e.first, std::move(e.second));
+          }
+          std::cout << "reuse index: " << reuse_table.entries.size() << " matrices from " << records << " records in " << msSince(began) << " ms" << std::endl;
+          compactIndex();
+      }
+
+      // drops the records of evicted and started over stores from the journal once they make up most of it, so it stays
+      // about as big as the table itself and the next startup replays only what is live
+      void compactIndex() {
+          try {
+              std::size_t dropped = reuse_table.index->compact(INDEX_COMPACT_MIN_DEAD);
+              if (dropped)
+                  std::cout << "reuse index: compacted, dropped " << dropped << " dead records" << std::endl;
+          } catch (const std::exception &e) {
+              // the old journal is still there and still right, just bigger
+              std::cerr << e.what() << std::endl;
+          }
+      }
+
+      // bytes a store of rows x cols matrices with the given number of blocks takes on disk
+      static std::size_t storeBytes(int rows, int cols, std::size_t blocks) {
+          std::size_t payload = (static_cast<std::size_t>(rows) * cols * sizeof(int) + 63) & ~static_cast<std::size_t>(63);
+          return sizeof(store_file_header) + blocks * (sizeof(store_block_header) + payload);
+      }
+
+      // loads cached power e of a matrix, from the RAM tier if it is there and from the store otherwise
+      // a dense power loaded from the store is offered to the RAM tier, which takes it if it is worth more than what it
+      // would push out; sparse powers are small enough to be copied out of the page cache every time
+      power_value loadPower(const std::shared_ptr<reuse_entry> &entry, int e, std::size_t offset, int below) {
+          if (std::shared_ptr<const Eigen::MatrixXi> m = reuse_table.ram->get(entry->digest, e)) {
+              reuse_table.stats.ram_loads++;
+              return power_value(mapped_matrix(m));
+          }
+          reuse_table.stats.disk_loads++;
+          if (entry->store->isSparse(offset))
+              return power_value(entry->store->readSparse(offset));
+          mapped_matrix m = entry->store->view(offset);
+          int evicted = reuse_table.ram->offer(entry->digest, e, m.mat, savedCompute(entry->dim, e, below));
+          if (evicted > 0)
+              reuse_table.stats.ram_evicted += evicted;
+          return power_value(std::move(m));
+      }
+
+      // the base matrix as the power chain starts from it: sparse if few enough of its elements are nonzero
+      power_value baseValue(const Eigen::MatrixXi &m) const {
+          if (sparse.density > 0 && fillOf(countNonZeros(m), m.rows(), m.cols()) <= sparse.density)
+              return power_value(sparse_matrix(m.sparseView()));
+          return power_value(m);
+      }
+
+      // brings the stores back under the disk budget, dropping the matrices whose cached powers are worth the least per
+      // byte (see keepScore) until they take 90% of it; a task still using a dropped store keeps reading its unlinked file
+      void evictDisk() {
+          if (!tiers.disk_bytes || reuse_table.stats.disk_bytes <= tiers.disk_bytes || reuse_table.evicting.exchange(true))
+              return;
+          struct candidate {
+              double score;
+              std::size_t bytes;
+              std::shared_ptr<reuse_entry> entry;
+          };
+          std::vector<candidate> candidates;
+          std::size_t evicted = 0;
+          time::steady_clock::time_point now = time::steady_clock::now();
+          reuse_table.entries.forEach([&](const matrix_digest &, const std::shared_ptr<reuse_entry> &entry){
+              std::lock_guard<std::mutex> lock(entry->m);
+              double saved = 0;
+              int below = 0;
+              for (const auto &e : entry->exps) {
+                  saved += savedCompute(entry->dim, e.first, below);
+                  below = e.first;
               }
-              res.row(count) = Eigen::Map<const Eigen::MatrixXi>(rowv.data(), 1, dimension);
+              std::size_t bytes = storeBytes(entry->dim, entry->cols, entry->exps.size());
+              double idle = time::duration_cast<time::milliseconds>(now - entry->used).count() / 1000.0;
+              candidates.push_back({keepScore(saved, idle, bytes), bytes, entry});
+          });
+          std::sort(candidates.begin(), candidates.end(), [](const candidate &a, const candidate &b){
+              return a.score < b.score;
+          });
+          for (const candidate &c : candidates) {
+              if (reuse_table.stats.disk_bytes <= tiers.disk_bytes / 10 * 9)
+                  break;
+              std::lock_guard<std::mutex> lock(reuse_table.evict_m);
+              // replaced meanwhile, leave the new one alone
+              if (!reuse_table.entries.erase(c.entry->digest, c.entry))
+                  continue;
+              unlink(storePath(c.entry->digest).c_str());
+              // journal it so a restarted CN doesn't look for the store
+              reuse_table.index->append(c.entry->digest, 0, c.entry->dim, c.entry->cols, 0);
+              reuse_table.ram->drop(c.entry->digest);
+              reuse_table.stats.disk_bytes -= std::min<std::size_t>(c.bytes, reuse_table.stats.disk_bytes);
+              reuse_table.stats.disk_evicted++;
+              evicted++;
+          }
+          // every eviction left a journal record and orphaned the store's own
+          if (evicted)
+              compactIndex();
+          reuse_table.evicting = false;
+      }
+
+      // logs hit ratios and tier sizes, so CN nodes can be sized from real traffic
+      void reportTiers() {
+          const tier_stats &st = reuse_table.stats;
+          std::size_t loads = st.ram_loads + st.disk_loads;
+          std::cout << "reuse tiers: " << st.hits << '/' << st.lookups << " matrices found ("
+                    << (st.lookups ? 100.0 * st.hits / st.lookups : 0.0) << "%), "
+                    << loads << " cached powers loaded, " << (loads ? 100.0 * st.ram_loads / loads : 0.0) << "% from ram; "
+                    << "ram " << (reuse_table.ram->bytes() >> 20) << '/' << (tiers.ram_bytes >> 20) << " MB, "
+                    << "disk " << (st.disk_bytes >> 20) << '/' << (tiers.disk_bytes >> 20) << " MB; "
+                    << "evicted " << st.ram_evicted << " ram, " << st.disk_evicted << " disk; "
+                    << "writer skipped " << reuse_table.writer->skipped() << ", coalesced " << reuse_table.writer->coalesced() << "; "
+                    << "tile products " << tiles.hits() << " reused, " << tiles.misses() << " computed, " << (tiles.bytes() >> 20) << '/' << (tile.bytes >> 20) << " MB" << std::endl;
+          if (spec.interval > time::milliseconds::zero())
+              std::cout << "speculation: " << spec_stats.runs << " runs (" << spec_stats.preempted << " preempted, " << spec_stats.over_budget << " skipped over budget), "
+                        << spec_stats.multiplies << " multiplications, " << spec_stats.powers << " powers cached, " << spec_stats.hits << " used by requests ("
+                        << (spec_stats.powers ? 100.0 * spec_stats.hits / spec_stats.powers : 0.0) << "%), "
+                        << spec_stats.busy_us / 1000000.0 << " s busy (" << 100.0 * spec_stats.busy_us / std::max(msSince(started) * 1000, 1.0) << "% of the time)" << std::endl;
+          m_scheduler.scheduleEvent(tiers.report_interval, [this]{
+              reportTiers();
+          });
+      }
+
+      // looks up a matrix in the reuse table
+      // entries that came from the index are checked against their store on first use: every block the index lists
+      // must be where it says, and the entry is dropped if the store is gone or lost its base matrix
+      std::shared_ptr<reuse_entry> findEntry(const matrix_digest &digest) {
+          std::optional<std::shared_ptr<reuse_entry> > found = reuse_table.entries.find(digest);
+          if (!found)
+              return nullptr;
+          std::shared_ptr<reuse_entry> entry = std::move(*found);
+          std::map<int, std::size_t> exps;
+          {
+              std::lock_guard<std::mutex> lock(entry->m);
+              if (entry->store)
+                  return entry;
+              exps = entry->exps;
+          }
+          // validate without holding any lock; nothing else touches an entry before it has a store
+          std::shared_ptr<matrix_store> store;
+          try {
+              std::string path(storePath(digest));
+              if (access(path.c_str(), F_OK))
+                  throw std::runtime_error("its store is gone");
+              store = std::make_shared<matrix_store>(path, entry->dim, entry->cols);
+              for (auto e = exps.begin(); e != exps.end();) {
+                  if (store->holds(e->second, e->first))
+                      ++e;
+                  else
+                      e = exps.erase(e);
+              }
+              if (!exps.count(1))
+                  throw std::runtime_error("its base matrix is missing from the store");
+          } catch (const std::exception &e) {
+              std::cerr << "dropping cached matrix " << digestToHex(digest) << ": " << e.what() << std::endl;
+              store = nullptr;
+          }
+          if (!store) {
+              // only drop it if nobody replaced it meanwhile
+              reuse_table.entries.erase(digest, entry);
+              found = reuse_table.entries.find(digest);
+              return found ? *found : nullptr;
+          }
+          {
+              std::lock_guard<std::mutex> lock(entry->m);
+              // unless someone else validated it first
+              if (!entry->store) {
+                  entry->exps = std::move(exps);
+                  entry->store = std::move(store);
+              }
+          }
+          // replaced meanwhile, take whatever is there now
+          found = reuse_table.entries.find(digest);
+          return found ? *found : nullptr;
+      }
+
+      // puts a matrix the table has never seen into it: starts a fresh store (a leftover file from an earlier run is
+      // overwritten) with m (which must own its elements) as its first block, exponent 1
+      std::shared_ptr<reuse_entry> cacheMatrix(const matrix_digest &digest, const power_value &m) {
+          std::string filename(storePath(digest));
+          std::shared_ptr<reuse_entry> entry = std::make_shared<reuse_entry>();
+          entry->digest = digest;
+          entry->dim = m.rows();
+          entry->cols = m.cols();
+          entry->used = time::steady_clock::now();
+          {
+              std::lock_guard<std::mutex> lock(reuse_table.evict_m);
+              unlink(filename.c_str());
+              entry->store = std::make_shared<matrix_store>(filename, entry->dim, entry->cols);
+              entry->exps.emplace(1, entry->store->append({m.block(1)}).front());
+              reuse_table.index->append(digest, 1, entry->dim, entry->cols, entry->exps[1]);
+              // create the entry in the reuse table (the store is written already, so this only takes the shard lock)
+              reuse_table.entries.assign(digest, entry);
+          }
+          reuse_table.stats.disk_bytes += storeBytes(entry->dim, entry->cols, 1);
+          evictDisk();
+          return entry;
+      }
+
+      // hands power e of a cached matrix to the store writer, which adds it to the entry once it is written
+      // returns false if the writer's queue had no room for it
+      bool persistPower(const std::shared_ptr<reuse_entry> &entry, int e, const power_value &m) {
+          return reuse_table.writer->submit(entry->store, entry->digest, e, m, [this, entry, e](std::size_t offset){
+              {
+                  // the block is written, so the power is readable now
+                  std::lock_guard<std::mutex> lock(entry->m);
+                  entry->exps.emplace(e, offset);
+              }
+              reuse_table.stats.disk_bytes += storeBytes(entry->dim, entry->cols, 1) - sizeof(store_file_header);
+              evictDisk();
+          });
+      }
+
+      // c = a * b for products whose inputs other requests may share (a base matrix and its square, the operands of a chain)
+      // dense products of matrices spanning at least two tiles each way go through the tile cache, so a matrix that differs
+      // from an earlier one in a few blocks only recomputes the tile products those blocks are part of
+      void multiplyShared(const power_value &a, const power_value &b, power_value &c) {
+          if (!use_cache || tile.size <= 0 || a.sparse() || b.sparse() || std::min({a.rows(), a.cols(), b.cols()}) < 2 * tile.size) {
+              multiplyPowers(gemm, a, b, c, sparse.max_fill);
+              return;
+          }
+          Eigen::MatrixXi p;
+          std::size_t computed = tiledMultiply(gemm, tiles, tile.size, a.dense(), b.dense(), p);
+          std::size_t total = static_cast<std::size_t>((a.rows() + tile.size - 1) / tile.size) * ((a.cols() + tile.size - 1) / tile.size) * ((b.cols() + tile.size - 1) / tile.size);
+          if (computed < total)
+              std::cout << "reused " << total - computed << " of " << total << " tile products" << std::endl;
+          c = power_value(std::move(p));
+      }
+
+      // executes a power_plan; load(e) maps cached power e out of the store, checkpoint(e, m) is called for every power
+      // the plan computes (the squares of the chain and the partial products, the last of which is the result)
+      // all factors are powers of the same matrix, so they commute and are folded into the result as soon as they are available
+      // only res, sq and one scratch matrix are alive at a time, whatever the exponent
+      // a sparse base keeps every product sparse until it fills in past sparse.max_fill (see multiplyPowers)
+      template <typename Load, typename Checkpoint>
+      power_value runPlan(const power_plan &plan, const power_value &base, const std::set<int> &cached, Load load, Checkpoint checkpoint) {
+          power_value res;
+          // scratch for the products, swapped with res/sq so no temporary is allocated per dense multiplication
+          power_value tmp;
+          bool have_res = false;
+          // power of the matrix res currently holds
+          int res_exp = 0;
+          auto fold = [&](const power_value &m, int e){
+              if (have_res) {
+                  multiplyPowers(gemm, res, m, tmp, sparse.max_fill);
+                  res.swap(tmp);
+                  res_exp += e;
+                  checkpoint(res_exp, res);
+              } else {
+                  res = m;
+                  res_exp = e;
+              }
+              have_res = true;
+          };
+          std::set<int> factors(plan.factors.begin(), plan.factors.end());
+          if (plan.square_to) {
+              // walk the squaring chain, loading the powers of two we already have instead of squaring
+              power_value sq;
+              if (plan.square_from == 1)
+                  sq = base;
+              else
+                  sq = load(plan.square_from);
+              for (int p = plan.square_from; ; p *= 2) {
+                  if (factors.erase(p))
+                      fold(sq, p);
+                  if (p == plan.square_to)
+                      break;
+                  if (cached.count(p * 2))
+                      sq = load(p * 2);
+                  else {
+                      // the first square only depends on the base, which other requests may share blocks of
+                      if (p == 1)
+                          multiplyShared(sq, sq, tmp);
+                      else
+                          multiplyPowers(gemm, sq, sq, tmp, sparse.max_fill);
+                      sq.swap(tmp);
+                      checkpoint(p * 2, sq);
+                  }
+              }
+          }
+          // whatever is left are cached powers off the chain
+          for (auto it = factors.rbegin(); it != factors.rend(); ++it) {
+              if (*it == 1)
+                  fold(base, 1);
+              else
+                  fold(load(*it), *it);
           }
           return res;
       }
 
-      void multiplyMatrix(int ri, int dimension, int exponent, std::size_t hash) {
+      // computes A^exponent for requester ri and completes it; a task leading the flight for its matrix takes the requests that
+      // queued up behind it along, computing all of their exponents in one ascending chain and completing each as it is reached
+      // never throws: if the task fails, every requester it still owed a result gets the error, which is also returned
+      std::string multiplyMatrix(int ri, int dimension, int exponent, const matrix_digest &digest, bool lead) {
           std::cout << "start thread" << std::endl;
           // uncomment following to log cpu in timestamps.dat
 //          {
@@ -179,180 +550,132 @@ class Producer : noncopyable {
 //          }
           // save a reference to minimize operator[] calls
           client_handler &chr = ch[ri];
-          Eigen::MatrixXi res;
-          if (exponent <= 0)
-              // trivial case
-              res = Eigen::MatrixXi::Identity(dimension, dimension);
-          else {
-              // nontrivial; first check if we enabled reuse
-              if (use_cache) {
-                  // compare function for exponent-ordered set
-                  static auto compfirst = [](const std::pair<std::size_t, std::size_t> &a, const std::pair<std::size_t, std::size_t> &b){
-                      return a.first < b.first;
-                  };
-                  // state variables
-                  std::ostringstream oss;
-                  std::ofstream new_f;
-                  int i;
-                  std::string currmatstr;
-                  std::vector<Eigen::MatrixXi> cache_waitlist;
-                  std::shared_lock<std::shared_timed_mutex> slock(reuse_table.re_m);
-                  // check if the hash already exists in the reuse table
-                  if (chr.mat_tableid != reuse_table.umm.end()) {
-                      // it exists! we have it
-                      // let's get the matrix string
-                      currmatstr = chr.mat_tableid->first;
-                      // use the matrix string to retrieve an equal_range of all of the exponents and their respective byte offsets in the master file for the matrix
-                      auto its = reuse_table.umm.equal_range(chr.mat_tableid->first);
-                      slock.unlock();
-                      std::string filename("reusables/" + std::to_string(hash) + ".dat");
-                      std::set<std::pair<std::size_t, std::size_t>, decltype(compfirst)> exps(compfirst);
-                      // sort them in a set
-                      std::transform(its.first, its.second, std::inserter(exps, exps.begin()), [](const std::pair<std::string, std::pair<std::size_t, std::size_t> > &a){
-                          return a.second;
-                      });
-                      // now, we choose the exponent in the reuse table closest in difference to the exponent of the current task
-                      auto less_it = exps.upper_bound(std::make_pair(exponent, 0));
-                      if (less_it != exps.begin())
-                          --less_it;
-                      // we're going to use that exponent number as the STARTING point (i) for the multiplication, to save unnecessary multiplications
-                      i = less_it->first;
-                      slock.lock();
-                      {
-                          std::ifstream iFile(filename);
-                          std::string line;
-                          // get the actual base matrix associated with the hash from the file
-                          std::getline(iFile, line);
-                          // put it in an Eigen::MatrixXi
-                          chr.mat = strtoMatrix(line, dimension);
-                          // then, jump to the byte offset of the closest exponent and extract that matrix as the starting point
-                          iFile.seekg(less_it->second, std::ifstream::beg);
-                          std::getline(iFile, line);
-                          res = strtoMatrix(line, dimension);
-                      }
-                      slock.unlock();
-                      // now open the file for writing
-                      new_f.open(filename, std::ofstream::out | std::ofstream::app);
-                  } else {
-                      // hash does not exist in the reuse table, this is the first time we've seen it
-                      slock.unlock();
-                      // we turn chr.mat into a string to use later
-                      oss << chr.mat.format(PayloadFmt);
-                      currmatstr = oss.str();
-                      // clear the ostringstream
-                      oss.str(std::string());
-                      oss.clear();
-                      slock.lock();
-                      std::string filename("reusables/" + std::to_string(reuse_table.umm.hash_function()(currmatstr)) + ".dat");
-                      // check to see if matrix exists in reuse table
-                      if (reuse_table.umm.find(currmatstr) != reuse_table.umm.end()) {
-                          // it exists
-                          // use the matrix string to retrieve an equal_range of all of the exponents and their respective byte offsets in the master file for the matrix
-                          auto its = reuse_table.umm.equal_range(currmatstr);
-                          slock.unlock();
-                          std::set<std::pair<std::size_t, std::size_t>, decltype(compfirst)> exps(compfirst);
-                          // sort them in a set
-                          std::transform(its.first, its.second, std::inserter(exps, exps.begin()), [](const std::pair<std::string, std::pair<std::size_t, std::size_t> > &a){
-                              return a.second;
-                          });
-                          // now, we choose the exponent in the reuse table closest in difference to the exponent of the current task
-                          auto less_it = exps.upper_bound(std::make_pair(exponent, 0));
-                          if (less_it != exps.begin())
-                              --less_it;
-                          // we're going to use that exponent number as the STARTING point (i) for the multiplication, to save unnecessary multiplications
-                          i = less_it->first;
-                          slock.lock();
+          time::steady_clock::time_point began = time::steady_clock::now();
+          // the plans actually executed, for the cost model
+          power_plan plan;
+          // exponent -> requesters completed once it is reached
+          std::map<int, std::vector<int> > targets;
+          targets[exponent].push_back(ri);
+          if (lead)
+              for (const rider &r : claimRiders(digest))
+                  targets[r.exponent].push_back(r.ri);
+          if (targets.size() > 1)
+              std::cout << "chain for ri " << ri << " carries " << targets.size() - 1 << " more exponents" << std::endl;
+          // result for ri's exponent, which the flight lands with; requesters the task couldn't complete get its error
+          std::string result("Done");
+          try {
+              // trivial cases
+              for (auto it = targets.begin(); it != targets.end() && it->first <= 0; it = targets.erase(it))
+                  for (int r : it->second)
+                      complete(r, "Done");
+              if (!targets.empty()) {
+                  // nontrivial; first check if we enabled reuse
+                  if (use_cache) {
+                      // state variables
+                      std::shared_ptr<reuse_entry> entry;
+                      // exponents of the matrix already in the reuse table -> their payload offsets in the store
+                      std::map<int, std::size_t> exps;
+                      // check if onInterest already found the digest in the reuse table
+                      if (chr.entry) {
+                          // it exists! we have it
+                          entry = std::move(chr.entry);
+                          reuse_table.stats.hits++;
                           {
-                              std::ifstream iFile(filename);
-                              std::string line;
-                              // advance to the byte offset to grab the matrix as the starting point
-                              iFile.seekg(less_it->second);
-                              std::getline(iFile, line);
-                              res = strtoMatrix(line, dimension);
+                              std::lock_guard<std::mutex> lock(entry->m);
+                              exps = entry->exps;
+                              entry->used = began;
                           }
-                          slock.unlock();
-                          // now open the file for writing
-                          new_f.open(filename, std::ofstream::out | std::ofstream::app);
+                          // get the actual base matrix straight out of the RAM tier or the store
+                          chr.mat = loadPower(entry, 1, exps[1], 0).toDense();
                       } else {
-                          // first time ever seeing the matrix in the reuse table
-                          slock.unlock();
-                          // set the original matrix as the starting point because that's all we have
-                          res = chr.mat;
-                          oss << res.format(PayloadFmt);
-                          // open file for writing matrix
-                          new_f.open(filename, std::ofstream::out | std::ofstream::trunc);
-                          std::unique_lock<std::shared_timed_mutex> ulock(reuse_table.re_m);
-                          new_f << oss.str();
-                          // create entries in reuse table and the byte offsets table
-                          reuse_table.umm.emplace(currmatstr, std::make_pair(1, 0));
-                          reuse_table.byte_offsets.emplace(currmatstr, oss.str().size() + 1);
-                          ulock.unlock();
-                          oss.str(std::string());
-                          oss.clear();
-                          // set the starting point to the beginning
-                          i = 1;
-                      }
-                  }
-                  slock.lock();
-                  chr.mat_tableid = reuse_table.umm.end();
-                  slock.unlock();
-                  int j = i;
-                  // start the actual multiplication
-                  for (; i < exponent; i++)
-                      // while multiplying, copy the result into the cache_waitlist for recording later
-                      cache_waitlist.emplace_back(res *= chr.mat);
-                  // multiplication has finished
-                  if (j < exponent) {
-                      // if there are things to cache, cache them
-                      std::lock_guard<std::mutex> lock(reuse_table.q_m);
-                      // check to see if there are too many cachers (changeable)
-                      if (reuse_table.cachers.size() >= std::thread::hardware_concurrency()) {
-                          std::cout << "too many cachers!" << std::endl;
-                          // join the cacher at the front of the queue
-                          if (reuse_table.cachers.front().joinable())
-                              reuse_table.cachers.front().join();
-                          // make room
-                          reuse_table.cachers.pop();
-                      }
-                      // push another cacher onto the queue
-                      reuse_table.cachers.emplace([=, oss = std::move(oss), new_f = std::move(new_f)]() mutable {
-                          std::cout << "start caching thread for ri " << ri << std::endl;
-                          int ival = j;
-                          std::lock_guard<std::shared_timed_mutex> ulock(reuse_table.re_m);
-                          // start recording the matrices to file
-                          for (; j < exponent; j++) {
-                              oss << cache_waitlist[j - ival].format(PayloadFmt);
-                              new_f << std::endl << oss.str();
-                              // add new entries to the reuse table for new exponents
-                              reuse_table.umm.emplace(currmatstr, std::make_pair(j + 1, reuse_table.byte_offsets[currmatstr]));
-                              reuse_table.byte_offsets[currmatstr] += oss.str().size() + 1;
-                              oss.str(std::string());
-                              oss.clear();
+                          // the consumer sent us the matrix, digest what we actually received
+                          matrix_digest d = digestMatrix(chr.mat);
+                          if (d != digest)
+                              std::cerr << "digest mismatch for ri " << ri << ", keying the table by the received matrix" << std::endl;
+                          // check to see if matrix exists in reuse table
+                          entry = findEntry(d);
+                          if (entry) {
+                              // it exists
+                              reuse_table.stats.hits++;
+                              std::lock_guard<std::mutex> lock(entry->m);
+                              exps = entry->exps;
+                              entry->used = began;
+                          } else {
+                              // first time ever seeing the matrix in the reuse table (a sparse matrix is stored sparse from the start)
+                              entry = cacheMatrix(d, baseValue(chr.mat));
+                              exps = entry->exps;
                           }
-                          std::cout << "end caching thread for ri " << ri << std::endl;
+                      }
+                      reuse_table.stats.lookups++;
+                      // powers speculation cached that this chain can start from
+                      spec_stats.hits += demand.claim(entry->digest, exps, targets.rbegin()->first);
+                      std::set<int> cached;
+                      std::transform(exps.begin(), exps.end(), std::inserter(cached, cached.begin()), [](const std::pair<const int, std::size_t> &a){
+                          return a.first;
                       });
+                      // maps a cached power out of the RAM tier or straight out of the store
+                      auto load = [&](int e){
+                          auto it = exps.find(e);
+                          return loadPower(entry, e, it->second, it == exps.begin() ? 0 : std::prev(it)->first);
+                      };
+                      // powers this task handed to the writer
+                      std::set<int> kept;
+                      std::size_t block_bytes = entry->store->payloadBytes() + sizeof(store_block_header);
+                      // streams a power to the store as soon as it is produced; the writer takes a copy and this task carries on,
+                      // so nothing piles up here however long the chain (the writer's queue is bounded and drops what doesn't fit)
+                      auto persist = [&](int e, const power_value &m){
+                          if (cached.count(e) || kept.count(e))
+                              return;
+                          // (counting every block as dense, which overestimates what sparse ones take)
+                          if (checkpoint.budget_bytes && (cached.size() + kept.size() + 1) * block_bytes > checkpoint.budget_bytes)
+                              return;
+                          {
+                              // skip exponents another task cached meanwhile
+                              std::lock_guard<std::mutex> lock(entry->m);
+                              if (entry->exps.count(e))
+                                  return;
+                          }
+                          if (persistPower(entry, e, m))
+                              kept.insert(e);
+                      };
+                      // start the actual multiplication
+                      runChain(targets, chr.mat, cached, load, [&](int e, const power_value &m){
+                          // closest smaller power we have or are about to have, for geometric spacing
+                          int below = 0;
+                          auto c = cached.lower_bound(e);
+                          if (c != cached.begin())
+                              below = *std::prev(c);
+                          auto k = kept.lower_bound(e);
+                          if (k != kept.begin())
+                              below = std::max(below, *std::prev(k));
+                          if (checkpoint.keep(e, below))
+                              persist(e, m);
+                      }, [&](int e, const power_value &m){
+                          // the targets themselves are worth keeping for exact hits later
+                          persist(e, m);
+                      }, plan);
+                  } else {
+                      // reuse disabled, so naively calculate (nothing leads a flight without reuse, so there is only ri)
+                      plan = naivePlan(exponent);
+                      Eigen::MatrixXi res = chr.mat, next;
+                      for (int i = 1; i < exponent; i++) {
+                          gemm.multiply(res, chr.mat, next);
+                          res.swap(next);
+                      }
+                      complete(ri, "Done");
+                      targets.clear();
                   }
-              } else {
-                  // reuse disabled, so naively calculate
-                  res = chr.mat;
-                  for (int i = 1; i < exponent; i++)
-                      res *= chr.mat;
               }
-          }
-          // we're not currently_operating anymore, so signal the waiting threads (if any)
-          currently_operating[hash].signal();
-          {
-              std::lock_guard<std::mutex> map_lock(map_m);
-              currently_operating.erase(hash);
-          }
-          std::cout << "signaled" << std::endl;
-          // finally set the content to the result
-          // for now, it just replies Done
-          {
-              std::lock_guard<std::mutex> locker(chr.m);
-              chr.content = "Done";
-              // thread is finished, set the ready flag
-              chr.tready = true;
+              compute_cost.observe(computeFeatures(dimension, plan), msSince(began));
+          } catch (const std::exception &e) {
+              // a store or the index failed under us; requesters that weren't completed yet are still in targets
+              std::cerr << "task for ri " << ri << " failed: " << e.what() << std::endl;
+              std::string error = std::string("Error: ") + e.what();
+              if (targets.count(exponent))
+                  result = error;
+              for (const auto &t : targets)
+                  for (int r : t.second)
+                      complete(r, error);
           }
           std::cout << "end thread" << std::endl;
           // uncomment following to log cpu in timestamps.dat
@@ -363,15 +686,588 @@ class Producer : noncopyable {
 //              log << "endcomp, ri: " << ri << " exp: " << exponent << ' ' << std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count() << std::endl;
 //              //
 //          }
+          return result;
+      }
+
+      // computes the powers in targets in ascending order, each one either planned from scratch or as the previous target
+      // times the gap between them, whichever the cached powers make cheaper; reached(e, m) is called with every target
+      // before the requesters waiting for it are completed (with "Done", the result for now) and it is taken out of targets,
+      // total sums up the plans
+      // a structured base (constant, identity, diagonal, permutation) skips all of that: every target has a closed form
+      // that costs O(dim^2), so there is nothing worth caching either (only called with reuse enabled; the reuse-disabled
+      // control multiplies naively whatever the structure)
+      template <typename Load, typename Checkpoint, typename Reached>
+      void runChain(std::map<int, std::vector<int> > &targets, const Eigen::MatrixXi &mat, const std::set<int> &cached, Load load, Checkpoint checkpoint, Reached reached, power_plan &total) {
+          // check what we actually got rather than trusting the name
+          matrix_structure structure = detectStructure(mat);
+          if (structure != STRUCTURE_GENERAL) {
+              std::cout << structureName(structure) << " matrix, closed form for " << targets.size() << " exponents" << std::endl;
+              // requesters only get "Done" for now, so there is nothing to compute; once results are shipped, each requester's
+              // A^e is closedFormPower(mat, its own canon with this structure, e)
+              for (const auto &t : targets)
+                  for (int r : t.second)
+                      complete(r, "Done");
+              targets.clear();
+              return;
+          }
+          power_value base = baseValue(mat);
+          if (base.sparse())
+              std::cout << "sparse matrix (" << base.fill() * 100 << "% filled), sparse products until they pass " << sparse.max_fill * 100 << '%' << std::endl;
+          power_value res;
+          int at = 0;
+          for (auto it = targets.begin(); it != targets.end(); it = targets.erase(it)) {
+              const auto &t = *it;
+              power_plan direct = planPower(t.first, cached);
+              power_plan gap = at ? planPower(t.first - at, cached) : direct;
+              bool extend = at && gap.multiplies + 1 < direct.multiplies;
+              const power_plan &plan = extend ? gap : direct;
+              std::cout << "plan for exponent " << t.first << ": " << plan.multiplies + extend << " multiplications" << (extend ? " on top of the previous one" : "") << std::endl;
+              power_value m = runPlan(plan, base, cached, load, checkpoint);
+              if (extend) {
+                  power_value next;
+                  multiplyPowers(gemm, res, m, next, sparse.max_fill);
+                  res.swap(next);
+              } else
+                  res.swap(m);
+              total.multiplies += plan.multiplies + extend;
+              total.factors.insert(total.factors.end(), plan.factors.begin(), plan.factors.end());
+              at = t.first;
+              reached(at, res);
+              for (int r : t.second)
+                  complete(r, "Done");
+          }
+      }
+
+      // runs on the io thread every spec.interval: when every worker is idle and speculation is within its share of the
+      // time, picks the most requested matrix whose next checkpoint (see speculationTarget) is in reach and precomputes it
+      void considerSpeculation() {
+          m_scheduler.scheduleEvent(spec.interval, [this]{
+              considerSpeculation();
+          });
+          if (speculating || pool.pending() || pool.idle() < pool.size())
+              return;
+          if (spec_stats.busy_us > spec.budget_share * msSince(started) * 1000) {
+              spec_stats.over_budget++;
+              return;
+          }
+          for (const matrix_demand &d : demand.popular()) {
+              std::shared_ptr<reuse_entry> entry = findEntry(d.digest);
+              if (!entry)
+                  continue;
+              std::set<int> cached;
+              {
+                  std::lock_guard<std::mutex> lock(entry->m);
+                  for (const auto &e : entry->exps)
+                      cached.insert(e.first);
+              }
+              if (cached.empty())
+                  continue;
+              int target = speculationTarget(checkpoint, d, *cached.rbegin());
+              if (!target || planPower(target, cached).multiplies > spec.max_multiplies)
+                  continue;
+              std::cout << "speculating on " << digestToHex(d.digest) << " (" << d.count << " recent requests, up to exponent " << d.max_exp
+                        << "): exponent " << target << std::endl;
+              speculating = true;
+              pool.submit([this, entry, target]{
+                  speculate(entry, target);
+                  speculating = false;
+              });
+              return;
+          }
+      }
+
+      // thrown out of a speculative chain to give the worker back
+      struct speculation_preempted {};
+
+      // computes power target of a cached matrix on a worker and caches it along with the checkpoints on the way
+      // it runs at low priority: after every multiplication it checks for request tasks (see submitRequest), and if there are
+      // any it stops there, keeping the powers it already handed to the store
+      void speculate(const std::shared_ptr<reuse_entry> &entry, int target) {
+          time::steady_clock::time_point began = time::steady_clock::now();
+          spec_stats.runs++;
+          std::map<int, std::size_t> exps;
+          {
+              // (not touching entry->used: only requests keep a matrix from being evicted)
+              std::lock_guard<std::mutex> lock(entry->m);
+              exps = entry->exps;
+          }
+          std::size_t block_bytes = entry->store->payloadBytes() + sizeof(store_block_header);
+          if (exps.count(target) || !exps.count(1) || (checkpoint.budget_bytes && (exps.size() + 1) * block_bytes > checkpoint.budget_bytes))
+              return;
+          std::set<int> cached;
+          for (const auto &e : exps)
+              cached.insert(e.first);
+          auto load = [&](int e){
+              auto it = exps.find(e);
+              return loadPower(entry, e, it->second, it == exps.begin() ? 0 : std::prev(it)->first);
+          };
+          try {
+              power_value base = loadPower(entry, 1, exps[1], 0);
+              // structured matrices have closed-form powers, there is nothing to gain
+              if (!base.sparse() && detectStructure(base.toDense()) != STRUCTURE_GENERAL)
+                  return;
+              // powers this run handed to the writer
+              std::set<int> kept;
+              runPlan(planPower(target, cached), base, cached, load, [&](int e, const power_value &m){
+                  spec_stats.multiplies++;
+                  int below = 0;
+                  auto c = cached.lower_bound(e);
+                  if (c != cached.begin())
+                      below = *std::prev(c);
+                  auto k = kept.lower_bound(e);
+                  if (k != kept.begin())
+                      below = std::max(below, *std::prev(k));
+                  if (!kept.count(e) && (e == target || checkpoint.keep(e, below)) && persistPower(entry, e, m)) {
+                      kept.insert(e);
+                      spec_stats.powers++;
+                      demand.speculated(entry->digest, e);
+                  }
+                  if (e != target && request_tasks > 0)
+                      throw speculation_preempted();
+              });
+          } catch (const speculation_preempted &) {
+              spec_stats.preempted++;
+              std::cout << "speculation on " << digestToHex(entry->digest) << " preempted by requests" << std::endl;
+          } catch (const std::exception &e) {
+              // the store went away under us (evicted)
+              std::cerr << "speculation on " << digestToHex(entry->digest) << " failed: " << e.what() << std::endl;
+          }
+          spec_stats.busy_us += time::duration_cast<time::microseconds>(time::steady_clock::now() - began).count();
+      }
+
+      // hands a multiplication task to the worker pool; the task completes its requesters itself
+      // a task leading the flight for its matrix lands it afterwards, completing every request that followed it
+      void submitMultiply(int ri, int dimension, int exponent, const matrix_digest &digest, bool lead) {
+          submitRequest([=]{
+              std::string result = multiplyMatrix(ri, dimension, exponent, digest, lead);
+              if (lead) {
+                  // lands even if the task failed, so followers of the same exponent get its error and the rest start over
+                  flights.finish(digest, flight_result{exponent, result});
+                  // forget the riders the flight's continuations took (riders of a newer flight stay)
+                  std::lock_guard<std::mutex> lock(riders_m);
+                  auto it = riders.find(digest);
+                  if (it != riders.end()) {
+                      it->second.erase(std::remove_if(it->second.begin(), it->second.end(), [](const rider &r){
+                          return r.taken->load();
+                      }), it->second.end());
+                      if (it->second.empty())
+                          riders.erase(it);
+                  }
+              }
+          });
+      }
+
+      // takes every request waiting to ride along on the next chain for a matrix (see followFlight)
+      std::vector<rider> claimRiders(const matrix_digest &digest) {
+          std::vector<rider> waiting;
+          {
+              std::lock_guard<std::mutex> lock(riders_m);
+              auto it = riders.find(digest);
+              if (it == riders.end())
+                  return waiting;
+              waiting.swap(it->second);
+              riders.erase(it);
+          }
+          // the flight's continuation may have taken some of them already
+          waiting.erase(std::remove_if(waiting.begin(), waiting.end(), [](const rider &r){
+              return r.taken->exchange(true);
+          }), waiting.end());
+          return waiting;
+      }
+
+      // a request for a matrix someone is already operating on: it waits as a rider, so the leader's chain can take it
+      // along when it starts multiplying, and follows the flight in case the leader started without it
+      // no thread waits either way: whichever of the two takes the rider first completes it
+      void followFlight(int requesterid, int dim, int exp, const matrix_digest &digest) {
+          std::shared_ptr<std::atomic<bool> > taken = std::make_shared<std::atomic<bool> >(false);
+          {
+              std::lock_guard<std::mutex> lock(riders_m);
+              riders[digest].push_back(rider{requesterid, exp, taken});
+          }
+          bool follow = flights.follow(digest, [=](const flight_result &r){
+              if (!taken->exchange(true))
+                  // the leader didn't take us along, carry on on the io thread like every other task start
+                  m_ioService.post([=]{
+                      onFlightLanded(requesterid, dim, exp, digest, &r);
+                  });
+          });
+          if (follow)
+              std::cout << "following the flight for " << digestToHex(digest) << std::endl;
+          else if (!taken->exchange(true))
+              // it landed in the meantime, so the matrix is in the table already
+              onFlightLanded(requesterid, dim, exp, digest, nullptr);
+      }
+
+      // stores the result of a task for the next poll
+      void complete(int ri, const std::string &result) {
+          client_handler &chr = ch[ri];
+          {
+              std::lock_guard<std::mutex> locker(chr.m);
+              chr.result = result;
+          }
+          // the result is ready, so let the requester know instead of leaving it to its next poll
+          notifyDone(ri);
+      }
+
+      // gets a task going once we know whether the reuse table has its matrix (chr.entry): straight to the pool if it
+      // does, otherwise after fetching the matrix from the requester
+      void startTask(int requesterid, int dim, int exp, const matrix_digest &digest, bool lead) {
+          client_handler &chr = ch[requesterid];
+          if (chr.entry) {
+              // we can proceed directly to multiplying because we HAVE matrix in the table already
+              submitMultiply(requesterid, dim, exp, digest, lead);
+              return;
+          }
+          if (use_cache && structureNeedsNoData(chr.canon.structure)) {
+              // the canonical matrix is all ones or the identity, no need to ask for it
+              if (chr.canon.structure == STRUCTURE_CONSTANT)
+                  chr.mat = Eigen::MatrixXi::Ones(dim, dim);
+              else
+                  chr.mat = Eigen::MatrixXi::Identity(dim, dim);
+              submitMultiply(requesterid, dim, exp, digest, false);
+              return;
+          }
+          // we need the client to send the matrix
+          // prepare
+          int rows = APP_OCTET_LIM / (dim * 4);
+          chr.mat.conservativeResize(dim, dim);
+          chr.numinter = std::ceil(static_cast<double>(dim) / rows);
+          std::cout << "Number of interests sent: " << chr.numinter << std::endl;
+          std::string prefix("/edge-compute/requester/" + std::to_string(requesterid) + "/matrix/");
+          // fetch the parts through a congestion window instead of a fixed 30 ms spacing; the window grows while the
+          // requester keeps up and backs off when it doesn't (fetch.pacing still puts a floor under the spacing for Pi's)
+          if (chr.fetcher)
+              // a fetch left over from an earlier request of this client must not write into the new matrix
+              chr.fetcher->stop();
+          time::steady_clock::time_point fetch_start = time::steady_clock::now();
+          int parts = chr.numinter;
+          chr.fetcher = segment_fetcher::start(m_face, m_scheduler, face_m, chr.numinter, fetch,
+              [=](int i){
+                  // name requesting a specific part of the matrix, advertising that we take binary (and sparse) segments
+                  return Name(prefix + std::to_string(i * rows) + '/' + std::to_string(i * rows + rows) + "/" WIRE_BINARY_COMPONENT "/" WIRE_SPARSE_COMPONENT);
+              },
+              [=](int i, const Data &data){
+                  onData(data, requesterid, i, dim, rows);
+              },
+              [=]{
+                  transfer_cost.observe({1.0, static_cast<double>(parts)}, msSince(fetch_start));
+                  // we've received all of the data to our interests, so start multiplication
+                  submitMultiply(requesterid, dim, exp, digest, lead);
+              });
+      }
+
+      // the flight a request followed has landed (on the io thread); r is null if it landed before we could follow it
+      void onFlightLanded(int requesterid, int dim, int exp, const matrix_digest &digest, const flight_result *r) {
+          std::cout << "flight landed for ri " << requesterid << std::endl;
+          if (r && r->exponent == exp) {
+              // exact duplicate of the leader's task, its result is ours
+              complete(requesterid, r->result);
+              return;
+          }
+          // requests that landed together go on in one chain again: the first leads it, the rest ride along
+          if (!flights.lead(digest)) {
+              followFlight(requesterid, dim, exp, digest);
+              return;
+          }
+          // the matrix is in the table now, so we keep its entry to access it directly
+          // (if it was evicted meanwhile, startTask falls back to fetching it)
+          ch[requesterid].entry = findEntry(digest);
+          startTask(requesterid, dim, exp, digest, true);
+      }
+
+      // first Interest of a chain request: parses it, plans the multiplication order around the subproducts the reuse
+      // table has, and works out which operands the plan still needs from the requester; sets the reply (chr.m is held)
+      void beginChain(int requesterid, const std::string &s) {
+          client_handler &chr = ch[requesterid];
+          chain_task &task = chr.chain;
+          task = chain_task();
+          int start = nthOccurrence(s, "/", 5) + 1;
+          int end = nthOccurrence(s, "/", 6);
+          try {
+              task.dims = chainDimsFromString(s.substr(start, end - start));
+              for (std::size_t k = 0; k + 1 < task.dims.size(); k++) {
+                  start = end + 1;
+                  end = nthOccurrence(s, "/", 7 + k);
+                  matrix_digest d{};
+                  if (end == static_cast<int>(std::string::npos) || !digestFromHex(s.substr(start, end - start), d))
+                      throw std::invalid_argument("missing or malformed digest of operand " + std::to_string(k + 1));
+                  task.operands.push_back(d);
+              }
+          } catch (const std::invalid_argument &e) {
+              std::cerr << "bad chain request " << s << ": " << e.what() << std::endl;
+              // nothing to compute; the requester picks the error up with its next poll
+              task = chain_task();
+              chr.result = std::string("Error: ") + e.what();
+              chr.content = "CTT: 0, found";
+              ++chr.iteration;
+              return;
+          }
+          // a cached operand or subproduct must still have its block and the shape the chain expects
+          auto lookup = [&](int i, int j){
+              if (!use_cache)
+                  return false;
+              std::shared_ptr<reuse_entry> entry = findEntry(chainDigest(task.operands, i, j));
+              if (!entry || entry->dim != task.dims[i] || entry->cols != task.dims[j + 1])
+                  return false;
+              {
+                  std::lock_guard<std::mutex> lock(entry->m);
+                  if (!entry->exps.count(1))
+                      return false;
+              }
+              task.cached[std::make_pair(i, j)] = entry;
+              return true;
+          };
+          task.plan = planChain(task.dims, lookup);
+          // walk the plan down to the operands it actually multiplies
+          std::set<matrix_digest> wanted;
+          std::function<void(int, int)> leaves = [&](int i, int j){
+              if (task.cached.count(std::make_pair(i, j)))
+                  return;
+              if (i == j) {
+                  if (!lookup(i, i) && wanted.insert(task.operands[i]).second)
+                      task.missing.push_back(i);
+                  return;
+              }
+              leaves(i, task.plan.at(i, j));
+              leaves(task.plan.at(i, j) + 1, j);
+          };
+          leaves(0, task.dims.size() - 2);
+          std::cout << "chain of " << task.operands.size() << " matrices: " << task.plan.cost << " multiply-adds, "
+                    << task.cached.size() << " cached operands and subproducts, " << task.missing.size() << " operands to fetch" << std::endl;
+          chr.requested = time::steady_clock::now();
+          chr.expected = expectChainTime(chr);
+          chr.content = "CTT: " + std::to_string(estimateTime(requesterid));
+          if (task.missing.empty())
+              chr.content += ", found";
+      }
+
+      // fetches the operands of a chain the reuse table lacks, through one congestion window for all of them, then
+      // hands the chain to the pool
+      void startChain(int requesterid) {
+          client_handler &chr = ch[requesterid];
+          chain_task &task = chr.chain;
+          if (task.dims.empty())
+              // malformed request, its result is set already
+              return;
+          if (task.missing.empty()) {
+              submitChain(requesterid);
+              return;
+          }
+          // segment i -> (operand position, first row, end row)
+          std::vector<std::tuple<int, int, int> > segments;
+          for (int k : task.missing) {
+              int rows = task.dims[k];
+              int cols = task.dims[k + 1];
+              int per = std::max(APP_OCTET_LIM / (cols * 4), 1);
+              task.fetched[task.operands[k]] = Eigen::MatrixXi::Zero(rows, cols);
+              for (int beg = 0; beg < rows; beg += per)
+                  segments.emplace_back(k, beg, std::min(beg + per, rows));
+          }
+          std::cout << "Number of interests sent: " << segments.size() << std::endl;
+          std::string prefix("/edge-compute/requester/" + std::to_string(requesterid) + "/operand/");
+          if (chr.fetcher)
+              chr.fetcher->stop();
+          time::steady_clock::time_point fetch_start = time::steady_clock::now();
+          chr.fetcher = segment_fetcher::start(m_face, m_scheduler, face_m, segments.size(), fetch,
+              [=, &task](int i){
+                  // operands are asked for by digest, in binary (the chain consumer has no text format)
+                  return Name(prefix + digestToHex(task.operands[std::get<0>(segments[i])]) + '/' + std::to_string(std::get<1>(segments[i])) + '/'
+                              + std::to_string(std::get<2>(segments[i])) + "/" WIRE_BINARY_COMPONENT "/" WIRE_SPARSE_COMPONENT);
+              },
+              [=, &task](int i, const Data &data){
+                  const Block &payload = data.getContent();
+                  try {
+                      decodeSegment(payload.value(), payload.value_size(), task.fetched.at(task.operands[std::get<0>(segments[i])]));
+                  } catch (const std::exception &e) {
+                      std::cerr << "bad operand segment " << data.getName() << ": " << e.what() << std::endl;
+                      // the chain can't be multiplied with it, nor anything of it cached (see multiplyChain)
+                      task.corrupt.insert(task.operands[std::get<0>(segments[i])]);
+                  }
+              },
+              [=]{
+                  transfer_cost.observe({1.0, static_cast<double>(segments.size())}, msSince(fetch_start));
+                  submitChain(requesterid);
+              });
+      }
+
+      void submitChain(int requesterid) {
+          submitRequest([=]{
+              multiplyChain(requesterid);
+          });
+      }
+
+      // queues a task that serves requesters, counting it in request_tasks until it returns (speculation yields to these)
+      void submitRequest(std::function<void()> task) {
+          request_tasks++;
+          pool.submit([this, task]{
+              // counts the task out however it returns
+              struct counted {
+                  std::atomic<int> &n;
+                  ~counted() {
+                      n--;
+                  }
+              } guard{request_tasks};
+              task();
+          });
+      }
+
+      // multiplies a chain in the planned order; every subproduct it computes goes into the reuse table (under the digest
+      // of its operands, see chainDigest), and so do the operands the requester sent
+      // an operand that didn't decode fails the chain; one that isn't what its digest claims is multiplied as received,
+      // but no subproduct containing it is cached, since chainDigest would key it by the claimed digest
+      void multiplyChain(int ri) {
+          client_handler &chr = ch[ri];
+          chain_task &task = chr.chain;
+          time::steady_clock::time_point began = time::steady_clock::now();
+          std::string result("Done");
+          try {
+              if (!task.corrupt.empty())
+                  throw std::runtime_error(std::to_string(task.corrupt.size()) + " operands did not decode");
+              // claimed digests of the operands that turned out to be something else
+              std::set<matrix_digest> mismatched;
+              if (use_cache) {
+                  reuse_table.stats.lookups++;
+                  if (task.missing.empty())
+                      reuse_table.stats.hits++;
+                  for (const auto &f : task.fetched) {
+                      matrix_digest d = digestMatrix(f.second);
+                      if (d != f.first) {
+                          std::cerr << "digest mismatch for an operand of ri " << ri << ", keying the table by the received matrix and caching no subproducts of it" << std::endl;
+                          mismatched.insert(f.first);
+                      }
+                      if (!findEntry(d))
+                          cacheMatrix(d, baseValue(f.second));
+                  }
+              }
+              // whether operands i..j are all what their digests say
+              auto verified = [&](int i, int j){
+                  for (int k = i; k <= j; k++)
+                      if (mismatched.count(task.operands[k]))
+                          return false;
+                  return true;
+              };
+              std::function<power_value(int, int)> product = [&](int i, int j){
+                  auto c = task.cached.find(std::make_pair(i, j));
+                  if (c != task.cached.end()) {
+                      std::shared_ptr<reuse_entry> entry = c->second;
+                      std::size_t offset;
+                      {
+                          std::lock_guard<std::mutex> lock(entry->m);
+                          offset = entry->exps.at(1);
+                          entry->used = began;
+                      }
+                      return loadPower(entry, 1, offset, 0);
+                  }
+                  if (i == j)
+                      return baseValue(task.fetched.at(task.operands[i]));
+                  int k = task.plan.at(i, j);
+                  power_value left = product(i, k);
+                  power_value right = product(k + 1, j);
+                  power_value res;
+                  multiplyShared(left, right, res);
+                  if (use_cache && verified(i, j)) {
+                      matrix_digest d = chainDigest(task.operands, i, j);
+                      if (!findEntry(d))
+                          cacheMatrix(d, res);
+                  }
+                  return res;
+              };
+              power_value res = product(0, task.dims.size() - 2);
+              std::cout << "chain for ri " << ri << " is " << res.rows() << 'x' << res.cols() << std::endl;
+          } catch (const std::exception &e) {
+              // an operand went missing between planning and multiplying, or arrived corrupt
+              std::cerr << "chain for ri " << ri << " failed: " << e.what() << std::endl;
+              result = std::string("Error: ") + e.what();
+          }
+          compute_cost.observe(chainFeatures(task), msSince(began));
+          // let go of the operands and pinned entries before handing out the result
+          task.fetched.clear();
+          task.cached.clear();
+          complete(ri, result);
+      }
+
+      // tells the requester that its result is ready so it can fetch it right away instead of sleeping out the CTT
+      // best effort: if this Interest is lost the requester still polls, so timeouts and Nacks are only logged
+      void notifyDone(int ri) {
+          Interest done(Name("/edge-compute/requester/" + std::to_string(ri) + "/done").appendVersion());
+          done.setInterestLifetime(1_s);
+          done.setMustBeFresh(true);
+          // lock mutex to make sure no one else is sending while we are
+          std::lock_guard<std::mutex> lock(face_m);
+          m_face.expressInterest(done,
+                                 [](const Interest &, const Data &){},
+                                 [](const Interest &i, const lp::Nack &nack){
+                                     std::cerr << "received Nack with reason " << nack.getReason() << " for interest " << i << std::endl;
+                                 },
+                                 [](const Interest &i){
+                                     std::cerr << "Timeout " << i << std::endl;
+                                 });
       }
 
 //      int estimateTime() {
 //          return log((iteration = 1) * 50.0) / log(1.005) - 750.0;
 //      }
 
-      // CTT estimation function
+      // cost model features of a multiplication: fixed cost, dense multiplications (each dim^3) and loading the operands (dim^2)
+      // the plan already accounts for how far the nearest cached powers are from the exponent
+      static std::vector<double> computeFeatures(int dimension, const power_plan &plan) {
+          double d = dimension;
+          return {1.0, plan.multiplies * d * d * d * 1e-9, (plan.factors.size() + 1) * d * d * 1e-6};
+      }
+
+      // cost model features of a chain, in the units of computeFeatures: multiply-adds left in its plan and the elements
+      // of the cached operands and subproducts it starts from
+      static std::vector<double> chainFeatures(const chain_task &task) {
+          double loads = 0;
+          for (const auto &c : task.cached)
+              loads += static_cast<double>(task.dims[c.first.first]) * task.dims[c.first.second + 1];
+          return {1.0, task.plan.cost * 1e-9, loads * 1e-6};
+      }
+
+      // expected time (ms) until the result of a chain is ready: fetching its missing operands, waiting for a worker,
+      // then running its plan
+      double expectChainTime(client_handler &chr) {
+          double transfer = 0;
+          if (!chr.chain.missing.empty()) {
+              double parts = 0;
+              for (int k : chr.chain.missing)
+                  parts += std::ceil(static_cast<double>(chr.chain.dims[k]) / std::max(APP_OCTET_LIM / (chr.chain.dims[k + 1] * 4), 1));
+              transfer = transfer_cost.predict({1.0, parts}, 0);
+          }
+          double compute = compute_cost.predict(chainFeatures(chr.chain), 0);
+          return transfer + queueWait(pool, compute_cost.mean()) + compute;
+      }
+
+      // expected time (ms) until the result of a new task is ready: fetching the matrix unless the table has it or
+      // someone else is fetching it, waiting for a worker, then running the plan the current table allows
+      double expectTime(client_handler &chr, int dimension, int exponent) {
+          std::set<int> cached;
+          if (chr.entry) {
+              std::lock_guard<std::mutex> lock(chr.entry->m);
+              for (const auto &e : chr.entry->exps)
+                  cached.insert(e.first);
+          }
+          double transfer = 0;
+          bool fetch_needed = !chr.entry && !chr.wait_to_grab && !(use_cache && structureNeedsNoData(chr.canon.structure));
+          if (fetch_needed) {
+              int rows = APP_OCTET_LIM / (dimension * 4);
+              transfer = transfer_cost.predict({1.0, std::ceil(static_cast<double>(dimension) / rows)}, 0);
+          }
+          // structured matrices take no multiplications at all (see closedFormPower)
+          power_plan plan = !use_cache ? naivePlan(exponent) : chr.canon.structure == STRUCTURE_GENERAL ? planPower(exponent, cached) : power_plan();
+          double compute = compute_cost.predict(computeFeatures(dimension, plan), 0);
+          return transfer + queueWait(pool, compute_cost.mean()) + compute;
+      }
+
+      // CTT estimation function: whatever is left of the expected completion time, and the old backoff curve once that
+      // has run out (or before the cost models have seen enough tasks to predict anything)
       int estimateTime(int ri) {
-          return log(++ch[ri].iteration * 50.0) / log(1.005) - 750.0;
+          client_handler &chr = ch[ri];
+          double remaining = chr.expected - msSince(chr.requested);
+          ++chr.iteration;
+          if (remaining >= 1)
+              return std::ceil(remaining);
+          return log(chr.iteration * 50.0) / log(1.005) - 750.0;
       }
 
       void onInterest(const InterestFilter& filter, const Interest& interest) {
@@ -392,11 +1288,11 @@ class Producer : noncopyable {
           std::string op = s.substr(start, end - start);
 
           int dim, exp;
-          std::size_t hash;
+          matrix_digest digest{};
 
           // client is not "registered", then create an entry for that requesterid with a client_handler instance to handle the matrix computation
           if (ch.find(requesterid) == ch.end())
-              ch.emplace(std::piecewise_construct, std::forward_as_tuple(requesterid), std::forward_as_tuple(reuse_table.umm.end()));
+              ch.emplace(std::piecewise_construct, std::forward_as_tuple(requesterid), std::make_tuple());
           // save a reference to minimize operator[] calls
           client_handler &chr = ch[requesterid];
 
@@ -406,9 +1302,15 @@ class Producer : noncopyable {
           data->setFreshnessPeriod(10_s); // 10 seconds
           {
               std::unique_lock<std::mutex> locker(chr.m, std::defer_lock);
-              if (op == "multiply") {
+              if (op == "multiply" || op == "chain") {
                   // check if this interest is the first for this task
-                  if (!chr.iteration) {
+                  if (!chr.iteration && op == "chain") {
+                      chr.counter = 0;
+                      chr.wait_to_grab = false;
+                      chr.entry = nullptr;
+                      locker.lock();
+                      beginChain(requesterid, s);
+                  } else if (!chr.iteration) {
                       // it's the first, so initialize state variables
                       chr.counter = 0;
                       chr.wait_to_grab = false;
@@ -428,52 +1330,55 @@ class Producer : noncopyable {
 //                       }
                       // if enabling reuse,
                       if (use_cache) {
-                          // extract hash
-                          hash = std::stoull(s.substr(end + 1));
-                          std::lock_guard<std::mutex> map_lock(map_m);
-                          // check to see if someone else is currently_operating on the matrix with the same hash
-                          if (currently_operating.find(hash) == currently_operating.end()) {
-                              // there isn't anyone currently_operating; create an entry in the currently_operating table, because now we operating on it
-                              currently_operating.emplace(std::piecewise_construct, std::forward_as_tuple(hash), std::make_tuple());
-                              // lock/increment semaphore to show that we are operating
-                              currently_operating[hash].wait();
-                          } else
-                              // there is somebody currently_operating on this matrix, so we wait to grab the results
-                              chr.wait_to_grab = true;
+                          // extract digest
+                          start = end + 1;
+                          end = nthOccurrence(s, "/", 8);
+                          if (!digestFromHex(s.substr(start, end - start), digest))
+                              std::cerr << "malformed digest in " << s << std::endl;
+                          // the canonical transform follows the digest (consumers from before it only send the digest and the version)
+                          chr.canon = canonical_params();
+                          if (dataName.size() >= 11) {
+                              start = end + 1;
+                              end = nthOccurrence(s, "/", 9);
+                              chr.canon.scale = std::stoi(s.substr(start, end - start));
+                              start = end + 1;
+                              end = nthOccurrence(s, "/", 10);
+                              chr.canon.transposed = s.substr(start, end - start) == "1";
+                              start = end + 1;
+                              end = nthOccurrence(s, "/", 11);
+                              chr.canon.structure = structureFromName(s.substr(start, end - start));
+                          }
+                          // a constant or identity matrix is fully described by its name, so there is nothing to fetch or share
+                          // lead the flight for this digest, unless somebody is already operating on it; then we follow theirs
+                          chr.wait_to_grab = !structureNeedsNoData(chr.canon.structure) && !flights.lead(digest);
+                          if (!structureNeedsNoData(chr.canon.structure))
+                              demand.record(digest, exp);
                       }
                       // lock the mutex to make sure nobody changes content while we are setting the CTT
                       locker.lock();
-                      chr.content = "CTT: " + std::to_string(estimateTime(requesterid));
-                      if (chr.wait_to_grab)
-                          // we found the hash and someone is using it, so tell the client that it does not have to send matrix
-                          chr.content += ", found";
-                      else {
+                      chr.entry = nullptr;
+                      if (use_cache && !chr.wait_to_grab && !structureNeedsNoData(chr.canon.structure)) {
                           // nobody is currently_operating on the matrix
-                          std::shared_lock<std::shared_timed_mutex> slock(reuse_table.re_m);
-                          auto hf = reuse_table.umm.hash_function();
-			  // see if we can find the hash of the matrix in the reuse table; if so we set the iterator for it so we can use it access it directly instead of searching through the entire table again
-
-                          for (auto it = reuse_table.umm.begin(); it != reuse_table.umm.end(); it++){
-                              if (hf(it->first) == hash) {
-                                  chr.mat_tableid = it;
-                                  break;
-                              }
-                          }
-                          if (chr.mat_tableid != reuse_table.umm.end())
-                              // we found the hash and someone ISN'T using it, so tell the client that it does not have to send matrix
-                              chr.content += ", found";
+                          // see if we can find the digest of the matrix in the reuse table; if so we keep its entry so we can access it directly later
+                          chr.entry = findEntry(digest);
                       }
+                      // the CTT counts from now, and depends on whether we still need the matrix
+                      chr.requested = time::steady_clock::now();
+                      chr.expected = expectTime(chr, dim, exp);
+                      chr.content = "CTT: " + std::to_string(estimateTime(requesterid));
+                      if (chr.wait_to_grab || chr.entry || (use_cache && structureNeedsNoData(chr.canon.structure)))
+                          // we found the digest (someone is using it, or it is in the table) or don't need the matrix at all, so tell the client that it does not have to send matrix
+                          chr.content += ", found";
                   } else {
                       // lock the mutex to make sure nobody changes content while we are setting the result
                       locker.lock();
-                      if (!chr.tready) {
-                          // the thread is not done, so set the CTT
+                      if (!chr.result) {
+                          // the task is not done, so set the CTT
                           chr.content = "CTT: " + std::to_string(estimateTime(requesterid));
                       } else {
-                          // the thread is done, the result is already set in content, so join the thread, reset some variables
-                          if (chr.work.joinable())
-                              chr.work.join();
-                          chr.tready = false;
+                          // the task is done, hand out its result and reset some variables
+                          chr.content = std::move(*chr.result);
+                          chr.result.reset();
                           chr.iteration = 0;
                       }
                   }
@@ -502,73 +1407,36 @@ class Producer : noncopyable {
 
           if (chr.iteration == 1) {
               // first interest, there's some stuff to do
-              if (chr.wait_to_grab) {
-                  // we decided earlier that someone is currently operating on my matrix, so we wait
-                  chr.work = std::thread([&, hash, requesterid, dim, exp]{
-                      // wait for the guy who's currently_operating to finish and notify us
-                      currently_operating[hash].wait();
-                      std::cout << "done waiting" << std::endl;
-                      // NOW we can execute this task because we know it's in the table
-                      {
-                          std::shared_lock<std::shared_timed_mutex> slock(reuse_table.re_m);
-                          auto hf = reuse_table.umm.hash_function();
-                          // we KNOW that the hash of the matrix is in the table, so we set the iterator for it so we can use it access it directly instead of searching through the entire table again
-                          for (auto it = reuse_table.umm.begin(); it != reuse_table.umm.end(); it++){
-                              if (hf(it->first) == hash) {
-                                  chr.mat_tableid = it;
-                                  break;
-                              }
-                          }
-                      }
-                      // proceed to multiplying with an iterator pointing to the exact matrix entry we want to use
-                      multiplyMatrix(requesterid, dim, exp, hash);
-                  });
-              } else {
-                  // we shouldn't wait because nobody is operating on this matrix right now
-                  std::shared_lock<std::shared_timed_mutex> slock(reuse_table.re_m);
-                  // is the hash already in the reuse table?
-                  if (chr.mat_tableid == reuse_table.umm.end()) {
-                      // nope, so we need the client to send the matrix
-                      slock.unlock();
-                      // prepare
-                      int rows = APP_OCTET_LIM / (dim * 4);
-                      int start = nthOccurrence(s, "/", 2) + 1;
-                      chr.mat.conservativeResize(dim, dim);
-                      chr.numinter = std::ceil(static_cast<double>(dim) / rows);
-                      std::cout << "Number of interests sent: " << chr.numinter << std::endl;
-                      for (int i = 0; i < chr.numinter; i++) {
-                          // create interest requesting for a specific part of the matrix
-                          Interest matreq(Name(s.replace(start, std::string::npos, "requester/" + std::to_string(requesterid) + "/matrix/" + std::to_string(i * rows) + '/' + std::to_string(i * rows + rows))).appendVersion());
-                          matreq.setInterestLifetime(1_s);
-                          matreq.setMustBeFresh(true);
-
-                          // schedule the events in 30 millisecond intervals (hardware requirement for Pi's)
-                          // they all run in separate threads for very short periods
-                          m_scheduler.scheduleEvent(time::milliseconds(i * 30), [=]{
-                              // lock mutex to make sure no one else is sending while we are
-                              std::lock_guard<std::mutex> lock(face_m);
-                              m_face.expressInterest(matreq,
-                                                     bind(&Producer::onData, this, _1, _2, requesterid, i, dim, exp, rows, hash),
-                                                     bind(&Producer::onNack, this, _1, _2),
-                                                     bind(&Producer::onTimeout, this, _1, requesterid, i, dim, exp, rows, hash));
-                          });
-
-                      }
-                  } else {
-                      // yes, so we can proceed directly to multiplying because we HAVE matrix in the table already
-                      slock.unlock();
-                      chr.work = std::thread(&Producer::multiplyMatrix, this, requesterid, dim, exp, hash);
-                  }
-              }
+              if (op == "chain")
+                  startChain(requesterid);
+              else if (chr.wait_to_grab)
+                  // we decided earlier that someone is currently operating on my matrix, so we ride along with it
+                  followFlight(requesterid, dim, exp, digest);
+              else
+                  // nobody is operating on this matrix, so we lead (with reuse enabled, and unless there is nothing to share)
+                  startTask(requesterid, dim, exp, digest, use_cache && !structureNeedsNoData(chr.canon.structure));
           }
           std::cout << "end onInterest" << std::endl;
       }
 
-      void onData(const Interest& interest, const Data& data, int ri, int crow, int dimension, int exponent, int r, std::size_t hash) {
+      void onData(const Data& data, int ri, int crow, int dimension, int r) {
           // we received part of the matrix, so we need to know where to put it
           // save a reference to minimize operator[] calls
           client_handler &chr = ch[ri];
-          std::string dcontent(reinterpret_cast<const char *>(data.getContent().value()), data.getContent().value_size());
+          const Block &payload = data.getContent();
+          if (isBinarySegment(payload.value(), payload.value_size())) {
+              // binary segment, it carries its own row range and decodes straight into the matrix
+              try {
+                  decodeSegment(payload.value(), payload.value_size(), chr.mat);
+              } catch (const std::exception &e) {
+                  std::cerr << "bad matrix segment " << data.getName() << ": " << e.what() << std::endl;
+              }
+              chr.counter++;
+              std::cout << "Count: " << chr.counter << std::endl;
+              return;
+          }
+          // text segment from a consumer that doesn't speak the binary format
+          std::string dcontent(reinterpret_cast<const char *>(payload.value()), payload.value_size());
           // iterate over rows (delimited by "|")
           for (std::size_t index = 0, count = 0; index != dcontent.size(); index = dcontent.find("|", index) + 1, count++) {
               std::vector<int> rowv;
@@ -585,33 +1453,9 @@ class Producer : noncopyable {
               // set the corresponding row in the Eigen::MatrixXi we have here
               chr.mat.row(crow * r + count) = Eigen::Map<const Eigen::MatrixXi>(rowv.data(), 1, dimension);
           }
-          std::string intername(interest.toUri());
-          std::string dataname(data.getName().toUri());
-          // compare interest name with data name (without metadata)
-          if (intername.substr(0, nthOccurrence(intername, "/", 7)) == dataname.substr(0, nthOccurrence(dataname, "/", 7)))
-              // data corresponds to the correct interest, so increment counter
-              chr.counter++;
+          // the fetcher only hands us data matching one of its interests, so count it
+          chr.counter++;
           std::cout << "Count: " << chr.counter << std::endl;
-          if (chr.counter == chr.numinter)
-              // we've received all of the data to our interests, so start multiplication
-              chr.work = std::thread(&Producer::multiplyMatrix, this, ri, dimension, exponent, hash);
-      }
-    
-      void onNack(const Interest& interest, const lp::Nack& nack) {
-          std::cerr << "received Nack with reason " << nack.getReason()
-                    << " for interest " << interest << std::endl;
-      }
-    
-      void onTimeout(const Interest& interest, int requesterid, int i, int dim, int exp, int rows, int hash) {
-          std::cerr << "Timeout " << interest << std::endl;
-          std::string intername = interest.toUri();
-          Interest send_this(Name(intername.substr(0, nthOccurrence(intername, "/", 7))).appendVersion());
-          std::lock_guard<std::mutex> locker(face_m);
-          // re-express the interest with a different Version to avoid the duplicate-Interest Nack
-          m_face.expressInterest(send_this,
-                                 bind(&Producer::onData, this, _1, _2, requesterid, i, dim, exp, rows, hash),
-                                 bind(&Producer::onNack, this, _1, _2),
-                                 bind(&Producer::onTimeout, this, _1, requesterid, i, dim, exp, rows, hash));
       }
 
       void onRegisterFailed(const Name& prefix, const std::string& reason) {
@@ -627,25 +1471,108 @@ class Producer : noncopyable {
         std::mutex face_m;
         Scheduler m_scheduler;
         bool use_cache;
-        static const Eigen::IOFormat PayloadFmt;
+        fetch_options fetch;
+        // which of the powers a multiplication computes get cached
+        checkpoint_policy checkpoint;
+        // budgets of the RAM and disk tiers of the reuse table
+        tier_options tiers;
+        // when matrices and their powers are kept sparse
+        sparse_options sparse;
+        // tiled reuse of the products of base matrices and chain operands
+        tile_options tile;
+        tile_cache tiles;
+        // precomputing powers of popular matrices while the pool is idle
+        speculation_options spec;
+        demand_tracker demand;
+        speculation_stats spec_stats;
+        std::atomic<bool> speculating;
+        // request tasks (multiplications and chains) queued or running; the pool itself can't tell them from the panels
+        // int_gemm hands to idle workers, including those of speculation's own products
+        std::atomic<int> request_tasks;
+        time::steady_clock::time_point started;
+        // multiplies for runPlan; may borrow idle workers of the pool
+        int_gemm gemm;
+        // measured cost of multiplying (see computeFeatures) and of fetching a matrix from the client (1, parts)
+        cost_model compute_cost;
+        cost_model transfer_cost;
         std::map<int, client_handler> ch;
         reusable_table reuse_table;
-        std::map<std::size_t, binary_sem> currently_operating;
-        std::mutex map_m;
+        // requests for a matrix that is already being worked on follow the leading task instead of fetching it again
+        single_flight<matrix_digest, flight_result> flights;
+        // digest -> requests waiting to ride along on the next chain for it
+        std::map<matrix_digest, std::vector<rider> > riders;
+        std::mutex riders_m;
         std::mutex file_m;
+        // declared last so the workers are joined before anything they use is torn down
+        work_pool pool;
 };
 
-const Eigen::IOFormat Producer::PayloadFmt(0, Eigen::DontAlignCols, ",", "|", "", "", "", "|");
-
 } // namespace examples
 } // namespace ndn
 
 int main(int argc, char** argv) {
-    if (argc != 2) {
-        std::cerr << "usage: ./MAC_matrix <Use Cache?>" << std::endl;
+    ndn::examples::fetch_options fetch;
+    ndn::examples::persist_options persist;
+    ndn::examples::checkpoint_policy checkpoint;
+    ndn::examples::tier_options tiers;
+    ndn::examples::sparse_options sparse;
+    ndn::examples::tile_options tile;
+    ndn::examples::speculation_options speculation;
+    ndn::examples::gemm_backend gemm = ndn::examples::gemm_backend::blocked;
+    bool usage = argc < 2;
+    // optional arguments come after the positional ones
+    for (int i = 2; i < argc; i++) {
+        std::string arg(argv[i]);
+        if (arg.compare(0, 9, "--pacing=") == 0)
+            fetch.pacing = ndn::time::milliseconds(std::atoi(arg.c_str() + 9));
+        else if (arg.compare(0, 16, "--persist-queue=") == 0)
+            persist.queue_bytes = static_cast<std::size_t>(std::max(std::atoi(arg.c_str() + 16), 0)) << 20;
+        else if (arg.compare(0, 8, "--fsync=") == 0)
+            persist.sync_interval = ndn::time::milliseconds(std::max(std::atoi(arg.c_str() + 8), 1));
+        else if (arg.compare(0, 6, "--ram=") == 0)
+            tiers.ram_bytes = static_cast<std::size_t>(std::max(std::atoi(arg.c_str() + 6), 0)) << 20;
+        else if (arg.compare(0, 7, "--disk=") == 0)
+            tiers.disk_bytes = static_cast<std::size_t>(std::max(std::atoi(arg.c_str() + 7), 0)) << 20;
+        else if (arg.compare(0, 8, "--stats=") == 0)
+            tiers.report_interval = ndn::time::seconds(std::max(std::atoi(arg.c_str() + 8), 1));
+        else if (arg.compare(0, 9, "--sparse=") == 0)
+            sparse.density = std::max(std::atof(arg.c_str() + 9), 0.0);
+        else if (arg.compare(0, 7, "--fill=") == 0)
+            sparse.max_fill = std::max(std::atof(arg.c_str() + 7), 0.0);
+        else if (arg.compare(0, 7, "--tile=") == 0)
+            tile.size = std::max(std::atoi(arg.c_str() + 7), 0);
+        else if (arg.compare(0, 13, "--tile-cache=") == 0)
+            tile.bytes = static_cast<std::size_t>(std::max(std::atoi(arg.c_str() + 13), 0)) << 20;
+        else if (arg.compare(0, 12, "--speculate=") == 0)
+            speculation.interval = ndn::time::milliseconds(std::max(std::atoi(arg.c_str() + 12), 0));
+        else if (arg.compare(0, 18, "--speculate-share=") == 0)
+            speculation.budget_share = std::min(std::max(std::atof(arg.c_str() + 18), 0.0), 1.0);
+        else if (arg.compare(0, 13, "--checkpoint=") == 0) {
+            try {
+                checkpoint = ndn::examples::checkpointPolicyFromString(arg.substr(13));
+            } catch (const std::invalid_argument &) {
+                usage = true;
+            }
+        } else if (arg.compare(0, 7, "--gemm=") == 0) {
+            try {
+                gemm = ndn::examples::gemmBackendFromString(arg.substr(7));
+            } catch (const std::invalid_argument &) {
+                usage = true;
+            }
+        } else
+            usage = true;
+    }
+    if (usage) {
+        std::cerr << "usage: ./MAC_matrix <Use Cache?> [--pacing=<min ms between interests to a client, default 30 for Pi's, 0 disables>] [--gemm=<eigen|blocked>]"
+                  << " [--persist-queue=<MB of powers waiting to be cached, 512>] [--fsync=<ms between syncs of the reuse store, 1000>]"
+                  << " [--checkpoint=<every|pow2|geometric[:ratio]|budget:<MB per matrix>>, pow2]"
+                  << " [--ram=<MB of hot powers kept in memory, 256>] [--disk=<MB of reuse stores, 4096, 0 for no limit>] [--stats=<s between tier reports, 60>]"
+                  << " [--sparse=<max density of a matrix computed sparse, 0.05, 0 disables>] [--fill=<density a sparse power switches to dense at, 0.15>]"
+                  << " [--tile=<edge of the tiles products are reused by, 256, 0 disables>] [--tile-cache=<MB of tile products kept, 512>]"
+                  << " [--speculate=<ms between looks for powers to precompute while idle, 1000, 0 disables>] [--speculate-share=<max share of the time spent on it, 0.2>]" << std::endl;
         return 1;
     }
-    ndn::examples::Producer producer(std::atoi(argv[1]));
+    ndn::examples::Producer producer(std::atoi(argv[1]), fetch, persist, checkpoint, tiers, sparse, tile, speculation, gemm);
     try {
       producer.run();
     }
@@ -30,6 +30,7 @@
 #include <dlib/image_io.h>
 
 #include <cstddef>
+#include <cstring>
 #include <iostream>
 #include <string>
 #include <thread>
@@ -41,6 +42,13 @@
 #include <set>
 #include <algorithm>
 #include <fstream>
+#include <optional>
+
+#include "cost_model.hpp"
+#include "fhog_reuse.hpp"
+#include "rolling_upscale.hpp"
+#include "segment_fetcher.hpp"
+#include "work_pool.hpp"
 
 #define UPSCALE 2
 #define APP_OCTET_LIM (MAX_NDN_PACKET_SIZE - 400)
@@ -68,24 +76,43 @@ namespace examples {
 struct client_handler {
     std::mutex m;
     std::string content;
-    bool tready;
+    // result of the finished task, set by its completion callback
+    std::optional<std::string> result;
     int iteration;
     dlib::array2d<unsigned char> img;
+    // the previous snapshot as it arrived (before upscaling), which a delta snapshot is stitched onto, and its overlap
+    // (reuse_table[frame_overlap] is its pyramid)
+    dlib::array2d<unsigned char> frame;
+    double frame_overlap;
+    // what the current snapshot's fetch asks for: the new columns on the right (delta) or every column
+    bool delta;
+    // how many pixels the camera moved since the previous snapshot, as the consumer says (0 if it didn't)
+    int shift;
+    int fetch_cols;
     int counter;
     int numinter;
-    std::thread work;
     int subnumber;
     dlib::frontal_face_detector detector;
+    // the detector's scanner settings and filters, for scanning pyramids we build ourselves
+    fhog_params fhog;
+    std::vector<fhog_scanner::fhog_filterbank> filterbanks;
     // reuse table data structure: note that for this application it is per client rather than per CN
-    // maps overlap percentage -> set of dlib::rectangles representing detected face coordinates
-    std::map<double, std::set<dlib::rectangle> > reuse_table;
+    // maps overlap percentage -> fHOG pyramid of the last snapshot taken with it
+    std::map<double, fhog_pyramid> reuse_table;
+    // fetch of the current snapshot's parts
+    std::shared_ptr<segment_fetcher> fetcher;
+    // when the current snapshot was requested and how long after that we expect its result to be ready (ms)
+    time::steady_clock::time_point requested;
+    double expected;
 
-    client_handler() : tready(false), iteration(0), counter(0), subnumber(0), detector(dlib::get_frontal_face_detector()) {}
+    client_handler()
+        : iteration(0), frame_overlap(-1), delta(false), shift(0), fetch_cols(0), counter(0), subnumber(0), detector(dlib::get_frontal_face_detector()), fhog(detector.get_scanner()),
+          filterbanks(buildFilterbanks(detector)), expected(0) {}
 };
 
 class Producer : noncopyable {
     public:
-        Producer(bool uc) : m_face(m_ioService), m_scheduler(m_ioService), use_cache(uc) {}
+        Producer(bool uc, const fetch_options &fo) : m_face(m_ioService), m_scheduler(m_ioService), use_cache(uc), fetch(fo), compute_cost(2), transfer_cost(2) {}
 
         void run() {
             // setup interest filter for computation requests
@@ -98,7 +125,7 @@ class Producer : noncopyable {
 
     private:
 
-      void detectImageFaces(int ri, double overlap, int width) {
+      std::string detectImageFaces(int ri, double overlap, int width) {
           std::cout << "start thread " << ri << std::endl;
           // uncomment following to log cpu in timestamps.dat
 //          {
@@ -109,45 +136,49 @@ class Producer : noncopyable {
 //          }
           // save a reference to minimize operator[] calls
           client_handler &chr = ch[ri];
-          // upscale the image to detect more faces
-          for (std::size_t i = 0; i < UPSCALE; i++)
-              dlib::pyramid_up(chr.img);
-          width *= UPSCALE * 2;
-          const std::size_t move = std::ceil(width * (1 - overlap));
-          // create a new entry for this overlap if one does not exist already
-          if (chr.reuse_table.find(overlap) == chr.reuse_table.end())
-              chr.reuse_table.emplace(std::piecewise_construct, std::forward_as_tuple(overlap), std::make_tuple());
-          dlib::sub_image_proxy<dlib::array2d<unsigned char> > sub(chr.img, dlib::rectangle(width - move, 0, chr.img.nc() - 1, chr.img.nr() - 1));
+          time::steady_clock::time_point began = time::steady_clock::now();
+          std::vector<double> features(detectFeatures(chr, overlap, chr.img.nr(), width));
+          // the previous snapshot's upscaled frame and pyramid are only reused if this one really is it moved by the step the
+          // consumer named, checked on the raw pixels
+          bool moved = use_cache && chr.frame_overlap == overlap && movedFrom(chr.img, chr.frame, chr.shift);
+          if (use_cache) {
+              // the next snapshot may only send what it adds to this one
+              dlib::assign_image(chr.frame, chr.img);
+              chr.frame_overlap = overlap;
+          }
+          // the step in pixels of the upscaled frame
+          const long shift = static_cast<long>(chr.shift) << UPSCALE;
           std::vector<dlib::rectangle> dets;
-          if (!chr.reuse_table[overlap].empty())
-              // this overlap percentage exists for this camera already, so we want to detect faces in the sub-image
-              dets = chr.detector(sub);
-          else
-              // this overlap percentage doesn't exist, we don't have anything for reference currently, so run the algorithm on the whole snapshot
+          if (use_cache) {
+              auto it = chr.reuse_table.find(overlap);
+              const fhog_pyramid *prev = it == chr.reuse_table.end() || !moved ? nullptr : &it->second;
+              if (it != chr.reuse_table.end() && !moved)
+                  std::cout << "snapshot is not the previous one moved by " << chr.shift << " pixels, building it from scratch" << std::endl;
+              // upscale the image to detect more faces; the previous snapshot's upscaled frame (the full-size level of its
+              // pyramid) already has most of it, so only the new columns are upscaled
+              dlib::array2d<unsigned char> up;
+              long upscaled = upscaleSnapshot(chr.img, UPSCALE, prev ? &prev->levels[0] : nullptr, shift, up);
+              std::cout << "columns upscaled: " << upscaled << " of " << chr.img.nc() << std::endl;
+              chr.img.swap(up);
+              // build the feature pyramid from the previous snapshot's wherever they overlap, then scan all of it
+              fhog_pyramid pyramid;
+              std::size_t total;
+              std::size_t reused = buildPyramid(chr.img, chr.fhog, prev, shift, pyramid, total);
+              std::cout << "fHOG columns reused: " << reused << " of " << total << std::endl;
+              dets = detectInPyramid(chr.detector, chr.filterbanks, chr.fhog, pyramid);
+              // keep this snapshot's pyramid for the next one
+              fhog_pyramid &kept = chr.reuse_table[overlap];
+              kept.levels.swap(pyramid.levels);
+              kept.feats.swap(pyramid.feats);
+          } else {
+              // upscale the image to detect more faces
+              for (std::size_t i = 0; i < UPSCALE; i++)
+                  dlib::pyramid_up(chr.img);
               dets = chr.detector(chr.img);
-          std::size_t total_faces = dets.size();
-          if (use_cache)
-              std::cout << "Faces detected in non-overlap: " << total_faces << std::endl;
-          if (!chr.reuse_table[overlap].empty()) {
-              // since we only detected faces in the sub-image, we need to retreive results for the overlapped region we didn't calculate over
-              std::vector<dlib::rectangle> relevant(chr.reuse_table[overlap].lower_bound(dlib::rectangle(dlib::point((chr.subnumber - 1) * move, 0))), chr.reuse_table[overlap].end());
-              // add overlapped region number of faces to the newly computed region for a sum over the whole snapshot
-              total_faces += relevant.size();
-              // translate rectangles to make absolute coordinates for the whole capture instead of ones relative to the current snapshot
-              std::transform(dets.begin(), dets.end(), dets.begin(), [&](const dlib::rectangle &a){
-                  return dlib::translate_rect(a, width - move + (chr.subnumber - 1) * move, 0);
-              });
           }
-          if (use_cache)
-              // save ordered set of rectangles (newly computed) for future use
-              chr.reuse_table[overlap].insert(dets.begin(), dets.end());
+          std::size_t total_faces = dets.size();
+          compute_cost.observe(features, msSince(began));
           std::cout << "Total faces detected: " << total_faces << std::endl;
-          {
-              std::lock_guard<std::mutex> locker(chr.m);
-              chr.content = std::to_string(total_faces);
-              // thread is finished, set the ready flag
-              chr.tready = true;
-          }
           std::cout << "end thread " << ri << std::endl;
           // uncomment following to log cpu in timestamps.dat
 //          {
@@ -156,11 +187,67 @@ class Producer : noncopyable {
 //              log << "endcomp, ri: " << ri << " width: " << width << ' ' << std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count() << std::endl;
 //              //
 //          }
+          // finally return the result
+          return std::to_string(total_faces);
+      }
+
+      // hands a detection task to the worker pool; its completion callback stores the result for the next poll
+      void submitDetect(int ri, double overlap, int width) {
+          pool.submit([=]{
+              return detectImageFaces(ri, overlap, width);
+          }, [=](const std::string &result){
+              client_handler &chr = ch[ri];
+              {
+                  std::lock_guard<std::mutex> locker(chr.m);
+                  chr.result = result;
+              }
+              // the result is ready, so let the requester know instead of leaving it to its next poll
+              notifyDone(ri);
+          });
+      }
+
+      // tells the requester that its result is ready so it can fetch it right away instead of sleeping out the CTT
+      // best effort: if this Interest is lost the requester still polls, so timeouts and Nacks are only logged
+      void notifyDone(int ri) {
+          Interest done(Name("/edge-compute/requester/" + std::to_string(ri) + "/done").appendVersion());
+          done.setInterestLifetime(1_s);
+          done.setMustBeFresh(true);
+          // lock mutex to make sure no one else is sending while we are
+          std::lock_guard<std::mutex> lock(face_m);
+          m_face.expressInterest(done,
+                                 [](const Interest &, const Data &){},
+                                 [](const Interest &i, const lp::Nack &nack){
+                                     std::cerr << "received Nack with reason " << nack.getReason() << " for interest " << i << std::endl;
+                                 },
+                                 [](const Interest &i){
+                                     std::cerr << "Timeout " << i << std::endl;
+                                 });
+      }
+
+      // cost model features of a detection: fixed cost and the number of pixels fHOG features are extracted from, which is
+      // only the non-overlapping strip once the overlap has a pyramid to reuse
+      std::vector<double> detectFeatures(client_handler &chr, double overlap, int height, int width) {
+          auto it = chr.reuse_table.find(overlap);
+          double scanned = static_cast<double>(height) * width;
+          if (it != chr.reuse_table.end())
+              scanned *= 1 - overlap;
+          return {1.0, scanned * 1e-6};
+      }
+
+      // segments a fetch of cols columns of every row takes
+      static int fetchParts(int height, int cols) {
+          return cols ? std::ceil(static_cast<double>(height) / (APP_OCTET_LIM / cols)) : 0;
       }
 
-      // CTT estimation function
+      // CTT estimation function: whatever is left of the expected completion time, and the old backoff curve once that
+      // has run out (or before the cost models have seen enough snapshots to predict anything)
       int estimateTime(int ri) {
-          return log(++ch[ri].iteration * 50.0) / log(1.005) - 750.0;
+          client_handler &chr = ch[ri];
+          double remaining = chr.expected - msSince(chr.requested);
+          ++chr.iteration;
+          if (remaining >= 1)
+              return std::ceil(remaining);
+          return log(chr.iteration * 50.0) / log(1.005) - 750.0;
       }
 
       void onInterest(const InterestFilter& filter, const Interest& interest) {
@@ -208,35 +295,53 @@ class Producer : noncopyable {
                       int sec = s.substr(start, end - start).find('x') + start;
                       height = std::stoi(s.substr(start, sec));
                       width = std::stoi(s.substr(sec + 1, end - start));
+                      // what follows the size: "first" (for counting trials), "delta/<shift>" (the camera moved shift columns
+                      // and the consumer offers just the new ones), "step/<shift>" (it moved, but only whole snapshots are
+                      // offered) or just the version
+                      std::string rest(s.substr(end + 1));
+                      std::string marker(rest.substr(0, rest.find('/')));
                       // For counting trials
 //                      if (nthOccurrence(s, "/", 8) != std::string::npos)
-                      if (s.substr(end + 1).find('/') != std::string::npos)
+                      if (marker == "first") {
                           chr.reuse_table.erase(overlap);
+                          chr.frame.clear();
+                      }
                       //
+                      // a delta snapshot is the previous one moved left by shift columns, plus whatever new columns that
+                      // exposes on the right; we only fetch those if we still have the previous one (and reuse is on),
+                      // and ask for every column otherwise, which the consumer serves just the same
+                      // the consumer's step is the only one we go by, for the columns copied here and the reuse in detection
+                      chr.delta = false;
+                      chr.fetch_cols = width;
+                      chr.shift = 0;
+                      if (marker == "delta" || marker == "step")
+                          chr.shift = std::stoi(rest.substr(marker.size() + 1));
+                      if (marker == "delta") {
+                          long kept = chr.frame.nc() - chr.shift;
+                          if (use_cache && chr.frame.nr() == height && chr.shift > 0 && kept > 0 && kept <= width) {
+                              chr.delta = true;
+                              chr.fetch_cols = width - kept;
+                          }
+                      }
                       // lock the mutex to make sure nobody changes content while we are setting the CTT
                       locker.lock();
+                      // expected completion: fetching the snapshot, waiting for a worker, then the detection
+                      chr.requested = time::steady_clock::now();
+                      chr.expected = transfer_cost.predict({1.0, static_cast<double>(fetchParts(height, chr.fetch_cols))}, 0)
+                                     + queueWait(pool, compute_cost.mean()) + compute_cost.predict(detectFeatures(chr, overlap, height, width), 0);
                       chr.content = "CTT: " + std::to_string(estimateTime(requesterid));
                   } else {
                       // lock the mutex to make sure nobody changes content while we are setting the result
                       locker.lock();
-                      if (!chr.tready) {
-                          // the thread is not done, so set the CTT
+                      if (!chr.result) {
+                          // the task is not done, so set the CTT
                           chr.content = "CTT: " + std::to_string(estimateTime(requesterid));
                       } else {
-                          // the thread is done, the result is already set in content, so join the thread, reset some variables
-                          if (chr.work.joinable())
-                              chr.work.join();
-                          chr.tready = false;
+                          // the task is done, hand out its result and reset some variables
+                          chr.content = std::move(*chr.result);
+                          chr.result.reset();
                           chr.iteration = 0;
                       }
-                      // failsafe if for ensuring that we don't continue to count replies to retransmission interests as part of a task where input data has already been completely received
-                      if (chr.counter != chr.numinter) {
-                          chr.counter = chr.numinter;
-                          // increment snapshot counter
-                          chr.subnumber++;
-                          // start detection
-                          chr.work = std::thread(&Producer::detectImageFaces, this, requesterid, overlap, width);
-                      }
                   }
               }
               data->setContent(reinterpret_cast<const uint8_t *>(chr.content.data()), chr.content.size());
@@ -262,77 +367,67 @@ class Producer : noncopyable {
           if (chr.iteration == 1) {
               // first interest, there's some stuff to do
               // prepare
-              int rows = APP_OCTET_LIM / width;
+              int cols = chr.fetch_cols;
+              // first column of the snapshot we fetch, everything left of it comes from the previous one
+              int col = width - cols;
+              int rows = cols ? APP_OCTET_LIM / cols : 0;
               int start = nthOccurrence(s, "/", 2) + 1;
               chr.img.set_size(height, width);
-              chr.numinter = std::ceil(static_cast<double>(height) / rows);
-              std::cout << "Number of interests sent: " << chr.numinter << std::endl;
-              for (int i = 0; i < chr.numinter; i++) {
-                  // create interest requesting for a specific part of the image
-                  Interest imgreq(Name(s.replace(start, std::string::npos, "requester/" + std::to_string(requesterid) + "/detectfaces/" + std::to_string(i * rows) + '/' + std::to_string(i * rows + rows))).appendVersion());
-                  imgreq.setInterestLifetime(2_s);
-                  imgreq.setMustBeFresh(true);
-
-                  // schedule the events in 30 millisecond intervals (hardware requirement for Pi's)
-                  // they all run in separate threads for very short periods
-                  m_scheduler.scheduleEvent(time::milliseconds(i * 30), [=]{
-                      // lock mutex to make sure no one else is sending while we are
-                      std::lock_guard<std::mutex> lock(face_m);
-                      m_face.expressInterest(imgreq,
-                                             bind(&Producer::onData, this, _1, _2, requesterid, i, overlap, width, rows),
-                                             bind(&Producer::onNack, this, _1, _2),
-                                             bind(&Producer::onTimeout, this, _1, requesterid, i, overlap, width, rows));
-                  });
+              if (chr.delta)
+                  // the overlap, moved over by the camera's step
+                  for (long r = 0; r < height; r++)
+                      std::copy(&chr.frame[r][0] + chr.shift, &chr.frame[r][0] + chr.shift + col, &chr.img[r][0]);
+              chr.numinter = fetchParts(height, cols);
+              std::cout << "Number of interests sent: " << chr.numinter << (chr.delta ? " for " + std::to_string(cols) + " new columns" : "") << std::endl;
+              std::string prefix(s.replace(start, std::string::npos, "requester/" + std::to_string(requesterid) + "/detectfaces/" + (chr.delta ? "delta/" : "")));
+              if (chr.fetcher)
+                  // a fetch left over from an earlier snapshot of this client must not write into the new one
+                  chr.fetcher->stop();
+              if (!chr.numinter) {
+                  // the camera reached the end of the scene, nothing new to fetch
+                  chr.subnumber++;
+                  submitDetect(requesterid, overlap, width);
+              } else {
+                  // fetch the parts through a congestion window instead of a fixed 30 ms spacing; the window grows while the
+                  // camera keeps up and backs off when it doesn't (fetch.pacing still puts a floor under the spacing for Pi's)
+                  // the fetcher counts every part exactly once, so replies to retransmissions can't start detection twice
+                  time::steady_clock::time_point fetch_start = time::steady_clock::now();
+                  int parts = chr.numinter;
+                  chr.fetcher = segment_fetcher::start(m_face, m_scheduler, face_m, chr.numinter, fetch,
+                      [=](int i){
+                          // name requesting a specific part of the image
+                          return Name(prefix + std::to_string(i * rows) + '/' + std::to_string(i * rows + rows));
+                      },
+                      [=](int i, const Data &data){
+                          onData(data, requesterid, i, cols, rows, col);
+                      },
+                      [=]{
+                          transfer_cost.observe({1.0, static_cast<double>(parts)}, msSince(fetch_start));
+                          // increment snapshot counter
+                          ch[requesterid].subnumber++;
+                          // we've received all the data to our interests for this snapshot, start face detection
+                          submitDetect(requesterid, overlap, width);
+                      });
               }
           }
           std::cout << "end onInterest" << std::endl;
       }
 
-      void onData(const Interest& interest, const Data& data, int ri, int crow, double ol, int w, int r) {
+      // part crow of the snapshot: r rows of the w columns starting at column col
+      void onData(const Data& data, int ri, int crow, int w, int r, int col) {
           // we received part of the image, so we need to know where to put it
           // save a reference to minimize operator[] calls
           client_handler &chr = ch[ri];
-          std::basic_string<unsigned char> dcontent(reinterpret_cast<const unsigned char *>(data.getContent().value()), data.getContent().value_size());
-          // iterate over rows
-          for (std::size_t index = 0; index < std::min(static_cast<std::size_t>(r), dcontent.size() / w); index++) {
-              std::basic_string<unsigned char> srow(dcontent.substr(index * w, w));
-              // iterate over columns in each row
-              for (std::size_t ei = 0; ei < srow.size(); ei++)
-                  // set the corresponding pixel in the dlib::array2d<unsigned char> we have
-                  chr.img[crow * r + index][ei] = srow[ei];
-          }
-          std::string intername(interest.toUri());
-          std::string dataname(data.getName().toUri());
-          // compare interest name with data name (without metadata)
-          if (intername.substr(0, nthOccurrence(intername, "/", 7)) == dataname.substr(0, nthOccurrence(dataname, "/", 7)))
-              // data corresponds to the correct interest, so increment counter
-              chr.counter++;
+          // the rows are copied straight out of the packet's buffer, one memcpy each, into the rows of the image
+          const Block &payload = data.getContent();
+          long rows = std::min<long>({r, static_cast<long>(payload.value_size() / w), chr.img.nr() - static_cast<long>(crow) * r});
+          if (col + w > chr.img.nc())
+              rows = 0;
+          for (long index = 0; index < rows; index++)
+              std::memcpy(&chr.img[crow * r + index][col], payload.value() + index * w, w);
+          // the fetcher only hands us data matching one of its interests, so count it
+          chr.counter++;
           std::cout << "Count: " << chr.counter << std::endl;
-          if (chr.counter == chr.numinter) {
-              // increment snapshot counter
-              chr.subnumber++;
-              // we've received all the data to our interests for this snapshot, start face detection
-              chr.work = std::thread(&Producer::detectImageFaces, this, ri, ol, w);
-          }
-      }
-    
-      void onNack(const Interest& interest, const lp::Nack& nack) {
-          std::cerr << "received Nack with reason " << nack.getReason()
-                    << " for interest " << interest << std::endl;
-      }
-    
-      void onTimeout(const Interest& interest, int requesterid, int i, double overlap, int width, int rows) {
-          std::cerr << "Timeout " << interest << std::endl;
-          if (ch[requesterid].counter != ch[requesterid].numinter) {
-              std::string intername(interest.toUri());
-              Interest send_this(Name(intername.substr(0, nthOccurrence(intername, "/", 7))).appendVersion());
-              std::lock_guard<std::mutex> locker(face_m);
-              // re-express the interest with a different Version to avoid the duplicate-Interest Nack
-              m_face.expressInterest(send_this,
-                                     bind(&Producer::onData, this, _1, _2, requesterid, i, overlap, width, rows),
-                                     bind(&Producer::onNack, this, _1, _2),
-                                     bind(&Producer::onTimeout, this, _1, requesterid, i, overlap, width, rows));
-          }
       }
 
       void onRegisterFailed(const Name& prefix, const std::string& reason) {
@@ -348,19 +443,35 @@ class Producer : noncopyable {
         std::mutex face_m;
         Scheduler m_scheduler;
         bool use_cache;
+        fetch_options fetch;
+        // measured cost of detecting faces (see detectFeatures) and of fetching a snapshot from the camera (1, parts)
+        cost_model compute_cost;
+        cost_model transfer_cost;
         std::map<int, client_handler> ch;
         std::mutex man_m;
+        // declared last so the workers are joined before anything they use is torn down
+        work_pool pool;
 };
 
 } // namespace examples
 } // namespace ndn
 
 int main(int argc, char** argv) {
-    if (argc != 2) {
-        std::cerr << "usage: ./MAC_simcamera <Use Cache?>" << std::endl;
+    ndn::examples::fetch_options fetch;
+    bool usage = argc < 2;
+    // optional arguments come after the positional ones
+    for (int i = 2; i < argc; i++) {
+        std::string arg(argv[i]);
+        if (arg.compare(0, 9, "--pacing=") == 0)
+            fetch.pacing = ndn::time::milliseconds(std::atoi(arg.c_str() + 9));
+        else
+            usage = true;
+    }
+    if (usage) {
+        std::cerr << "usage: ./MAC_simcamera <Use Cache?> [--pacing=<min ms between interests to a client, default 30 for Pi's, 0 disables>]" << std::endl;
         return 1;
     }
-    ndn::examples::Producer producer(std::atoi(argv[1]));
+    ndn::examples::Producer producer(std::atoi(argv[1]), fetch);
     try {
       producer.run();
     }
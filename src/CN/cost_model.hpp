@@ -0,0 +1,139 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2013-2018 Regents of the University of California.
+ *
+ * This file is part of ndn-cxx library (NDN C++ library with eXperimental eXtensions).
+ *
+ * ndn-cxx library is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later version.
+ *
+ * ndn-cxx library is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more details.
+ *
+ * You should have received copies of the GNU General Public License and GNU Lesser
+ * General Public License along with ndn-cxx, e.g., in COPYING.md file.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * See AUTHORS.md for complete list of ndn-cxx authors and contributors.
+ */
+
+#ifndef REUSE_EDGE_COST_MODEL_HPP
+#define REUSE_EDGE_COST_MODEL_HPP
+
+#include <ndn-cxx/util/time.hpp>
+
+#include <cstddef>
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include "work_pool.hpp"
+
+namespace ndn {
+namespace examples {
+
+// online model of how long some part of a task (computing, fetching the input, ...) takes, learned from the
+// durations we actually measured
+// durations are fitted against a small feature vector (x[0] should be 1 for the fixed cost) with recursive least
+// squares that slowly forgets old samples, so the fit follows changes in the CN's load; with log_space the log of the
+// duration is fitted instead, for costs that grow exponentially in a parameter (chess depth)
+// parameter sets that were measured before use the running average of their own durations, which beats any fit
+class cost_model {
+    public:
+        explicit cost_model(std::size_t features, bool log_space = false, double forget = 0.98)
+            : n_(features), log_(log_space), lambda_(forget), w_(features, 0.0), p_(features * features, 0.0), samples_(0), mean_(0) {
+            // large initial covariance: the first samples dominate the fit
+            for (std::size_t i = 0; i < n_; i++)
+                p_[i * n_ + i] = 1e4;
+        }
+
+        // records a measured duration in milliseconds for the features x
+        void observe(const std::vector<double> &x, double ms) {
+            std::lock_guard<std::mutex> lk(m_);
+            ms = std::max(ms, 0.1);
+            double y = log_ ? std::log(ms) : ms;
+            // RLS update: k = P x / (lambda + x' P x), w += k (y - w' x), P = (P - k x' P) / lambda
+            std::vector<double> px(n_, 0.0);
+            double xpx = 0;
+            for (std::size_t i = 0; i < n_; i++) {
+                for (std::size_t j = 0; j < n_; j++)
+                    px[i] += p_[i * n_ + j] * x[j];
+                xpx += x[i] * px[i];
+            }
+            double err = y - dot(x);
+            for (std::size_t i = 0; i < n_; i++)
+                w_[i] += px[i] / (lambda_ + xpx) * err;
+            for (std::size_t i = 0; i < n_; i++)
+                for (std::size_t j = 0; j < n_; j++)
+                    p_[i * n_ + j] = (p_[i * n_ + j] - px[i] * px[j] / (lambda_ + xpx)) / lambda_;
+            // exact parameter sets keep an exponentially weighted average of their own
+            auto it = seen_.find(x);
+            if (it == seen_.end())
+                seen_.emplace(x, ms);
+            else
+                it->second = 0.7 * it->second + 0.3 * ms;
+            mean_ = samples_ ? 0.9 * mean_ + 0.1 * ms : ms;
+            samples_++;
+        }
+
+        // expected duration in milliseconds for the features x, or fallback until there are enough samples to fit
+        double predict(const std::vector<double> &x, double fallback) const {
+            std::lock_guard<std::mutex> lk(m_);
+            auto it = seen_.find(x);
+            if (it != seen_.end())
+                return it->second;
+            if (samples_ < n_)
+                return fallback;
+            double y = dot(x);
+            return log_ ? std::exp(y) : std::max(y, 0.0);
+        }
+
+        // running average of everything observed, 0 before the first sample
+        double mean() const {
+            std::lock_guard<std::mutex> lk(m_);
+            return mean_;
+        }
+
+    private:
+        double dot(const std::vector<double> &x) const {
+            double y = 0;
+            for (std::size_t i = 0; i < n_; i++)
+                y += w_[i] * x[i];
+            return y;
+        }
+
+        mutable std::mutex m_;
+        std::size_t n_;
+        bool log_;
+        double lambda_;
+        std::vector<double> w_;
+        // covariance, n_ x n_ row-major
+        std::vector<double> p_;
+        std::size_t samples_;
+        double mean_;
+        std::map<std::vector<double>, double> seen_;
+};
+
+// milliseconds since t
+inline double msSince(time::steady_clock::time_point t) {
+    return time::duration_cast<time::microseconds>(time::steady_clock::now() - t).count() / 1000.0;
+}
+
+// expected time a task submitted now waits before a worker picks it up, given the average task duration
+// every worker busy and more tasks queued means waiting for (queued + 1) / workers tasks to finish, roughly
+inline double queueWait(const work_pool &pool, double task_ms) {
+    std::size_t busy = pool.size() - std::min(pool.idle(), pool.size());
+    std::size_t ahead = busy + pool.pending();
+    if (ahead < pool.size())
+        return 0;
+    return (ahead - pool.size() + 1) * task_ms / pool.size();
+}
+
+} // namespace examples
+} // namespace ndn
+
+#endif // REUSE_EDGE_COST_MODEL_HPP
@@ -0,0 +1,235 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2013-2018 Regents of the University of California.
+ *
+ * This file is part of ndn-cxx library (NDN C++ library with eXperimental eXtensions).
+ *
+ * ndn-cxx library is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later version.
+ *
+ * ndn-cxx library is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more details.
+ *
+ * You should have received copies of the GNU General Public License and GNU Lesser
+ * General Public License along with ndn-cxx, e.g., in COPYING.md file.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * See AUTHORS.md for complete list of ndn-cxx authors and contributors.
+ */
+
+
+#ifndef REUSE_EDGE_FHOG_REUSE_HPP
+#define REUSE_EDGE_FHOG_REUSE_HPP
+
+#include <dlib/image_processing/frontal_face_detector.h>
+
+#include <cstddef>
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include <vector>
+
+namespace ndn {
+namespace examples {
+
+// reuse of fHOG features between consecutive snapshots of a sliding camera
+// a snapshot overlapping the previous one by a fraction shares most of its pixels with it, only shifted to the left, so
+// most of the fHOG cells of each pyramid level are the previous snapshot's cells moved over by a few columns
+// a level reuses its columns only where its pixels provably are the previous level's shifted by a whole number of
+// cells (the levels are resampled, so that mostly holds for the full-size level and whichever others the shift happens
+// to divide evenly); everything else is extracted fresh, and the detector scans the joined pyramid as if it had built
+// it itself, so no face is cut in half at the border of the new strip
+
+typedef dlib::frontal_face_detector::image_scanner_type fhog_scanner;
+typedef fhog_scanner::pyramid_type fhog_pyramid_type;
+typedef dlib::array<dlib::array2d<float> > fhog_planes;
+
+// how the scanner of a detector builds and scans its pyramid, taken from its public settings the way scan_fhog_pyramid
+// derives them internally
+struct fhog_params {
+    int cell_size;
+    // the fHOG maps are padded by the filter size, so filters can slide off the edges
+    int filter_rows;
+    int filter_cols;
+    // size of the detection window in cells, without the padding
+    unsigned long box_rows;
+    unsigned long box_cols;
+    unsigned long min_level_width;
+    unsigned long min_level_height;
+    unsigned long max_levels;
+
+    explicit fhog_params(const fhog_scanner &scanner)
+        : cell_size(scanner.get_cell_size()), min_level_width(scanner.get_min_pyramid_layer_width()),
+          min_level_height(scanner.get_min_pyramid_layer_height()), max_levels(scanner.get_max_pyramid_levels()) {
+        dlib::rectangle window = dlib::grow_rect(dlib::image_to_fhog(dlib::centered_rect(dlib::point(0, 0), scanner.get_detection_window_width(),
+                                                                                          scanner.get_detection_window_height()), cell_size, 1, 1),
+                                                 scanner.get_padding());
+        filter_rows = window.height();
+        filter_cols = window.width();
+        box_rows = window.height() - 2 * scanner.get_padding();
+        box_cols = window.width() - 2 * scanner.get_padding();
+    }
+
+    // unpadded fHOG cells along a side of an image (extract_fhog_features drops the border cell at both ends)
+    int cells(long pixels) const {
+        return std::max(static_cast<int>(static_cast<double>(pixels) / cell_size + 0.5) - 2, 0);
+    }
+};
+
+// the fHOG pyramid of one snapshot, kept along with the images of its levels to tell what the next one shares with it
+struct fhog_pyramid {
+    dlib::array<dlib::array2d<unsigned char> > levels;
+    dlib::array<fhog_planes> feats;
+};
+
+// columns [a, b) (in the new level's pixels) where every row of level equals prev shifted left by d, widest run of them
+inline std::pair<long, long> matchingColumns(const dlib::array2d<unsigned char> &level, const dlib::array2d<unsigned char> &prev, long d) {
+    long overlap = std::min(level.nc(), prev.nc() - d);
+    if (d <= 0 || overlap <= 0 || level.nr() != prev.nr())
+        return std::make_pair(0L, 0L);
+    std::vector<bool> same(overlap, true);
+    for (long r = 0; r < level.nr(); r++) {
+        const unsigned char *now = &level[r][0];
+        const unsigned char *before = &prev[r][d];
+        bool any = false;
+        for (long x = 0; x < overlap; x++) {
+            if (same[x] && now[x] != before[x])
+                same[x] = false;
+            any = any || same[x];
+        }
+        // nothing left to find, e.g. a level the shift doesn't divide into whole pixels
+        if (!any)
+            return std::make_pair(0L, 0L);
+    }
+    std::pair<long, long> best(0, 0);
+    for (long x = 0; x < overlap;) {
+        long y = x;
+        while (y < overlap && same[y])
+            y++;
+        if (y - x > best.second - best.first)
+            best = std::make_pair(x, y);
+        x = y + 1;
+    }
+    return best;
+}
+
+// fHOG planes of the columns [beg, end) of img, laid out like the planes of the whole image from column beg / cell_size on
+inline void extractColumns(const dlib::array2d<unsigned char> &img, const fhog_params &p, long beg, long end, fhog_planes &out) {
+    dlib::const_sub_image_proxy<dlib::array2d<unsigned char> > strip(img, dlib::rectangle(beg, 0, end - 1, img.nr() - 1));
+    dlib::extract_fhog_features(strip, out, p.cell_size, p.filter_rows, p.filter_cols);
+}
+
+// copies the padded columns [from, from + n) of src to the columns [to, to + n) of dst
+inline void copyColumns(const fhog_planes &src, long from, fhog_planes &dst, long to, long n) {
+    if (n <= 0)
+        return;
+    for (unsigned long k = 0; k < dst.size(); k++)
+        for (long r = 0; r < dst[k].nr(); r++)
+            std::copy(&src[k][r][from], &src[k][r][from] + n, &dst[k][r][to]);
+}
+
+// builds the fHOG pyramid of img (the same levels and planes create_fhog_pyramid would), reusing the columns of prev
+// (the previous snapshot, shift pixels of the full-size level to the left) wherever the levels match; returns the
+// reused columns
+inline std::size_t buildPyramid(const dlib::array2d<unsigned char> &img, const fhog_params &p, const fhog_pyramid *prev, long shift,
+                                fhog_pyramid &out, std::size_t &total) {
+    fhog_pyramid_type pyr;
+    unsigned long count = 0;
+    dlib::rectangle rect = dlib::get_rect(img);
+    do {
+        rect = pyr.rect_down(rect);
+        ++count;
+    } while (rect.width() >= p.min_level_width && rect.height() >= p.min_level_height && count < p.max_levels);
+    out.levels.set_max_size(count);
+    out.levels.set_size(count);
+    out.feats.set_max_size(count);
+    out.feats.set_size(count);
+    dlib::assign_image(out.levels[0], img);
+    for (unsigned long l = 1; l < count; l++)
+        pyr(out.levels[l - 1], out.levels[l]);
+    // cells of the unpadded map start this many columns into the padded one
+    const long pad = (p.filter_cols - 1) / 2;
+    std::size_t reused = 0;
+    total = 0;
+    for (unsigned long l = 0; l < count; l++) {
+        const dlib::array2d<unsigned char> &level = out.levels[l];
+        fhog_planes &feats = out.feats[l];
+        long cols = p.cells(level.nc());
+        total += cols;
+        // columns [lo, hi) of the unpadded map come from prev; a cell depends on the pixels up to two cells around it
+        long lo = 0, hi = 0, d = 0;
+        if (prev && l < prev->levels.size() && shift > 0) {
+            d = std::lround(static_cast<double>(shift) * level.nc() / img.nc() / p.cell_size) * p.cell_size;
+            std::pair<long, long> same = matchingColumns(level, prev->levels[l], d);
+            lo = (same.first + p.cell_size - 1) / p.cell_size + 1;
+            hi = std::min(same.second / p.cell_size - 3, static_cast<long>(p.cells(prev->levels[l].nc())) - d / p.cell_size);
+        }
+        if (lo >= hi) {
+            dlib::extract_fhog_features(level, feats, p.cell_size, p.filter_rows, p.filter_cols);
+            continue;
+        }
+        const fhog_planes &before = prev->feats[l];
+        feats.set_max_size(before.size());
+        feats.set_size(before.size());
+        for (unsigned long k = 0; k < feats.size(); k++) {
+            feats[k].set_size(before[k].nr(), cols + p.filter_cols - 1);
+            dlib::assign_all_pixels(feats[k], 0);
+        }
+        fhog_planes strip;
+        if (lo > 0) {
+            // the left edge: extracted up to far enough right that cells [0, lo) don't see the strip's own edge
+            extractColumns(level, p, 0, std::min(level.nc(), (lo + 4) * p.cell_size), strip);
+            copyColumns(strip, pad, feats, pad, lo);
+        }
+        copyColumns(before, pad + lo + d / p.cell_size, feats, pad + lo, hi - lo);
+        // the newly exposed columns, starting far enough left that cells [hi, cols) don't see the strip's own edge
+        long beg = std::max(hi - 1, 0L) * p.cell_size;
+        extractColumns(level, p, beg, level.nc(), strip);
+        copyColumns(strip, pad + hi - beg / p.cell_size, feats, pad + hi, cols - hi);
+        reused += hi - lo;
+    }
+    return reused;
+}
+
+// the detector's filters, built once per detector (they don't depend on the image)
+inline std::vector<fhog_scanner::fhog_filterbank> buildFilterbanks(const dlib::frontal_face_detector &detector) {
+    std::vector<fhog_scanner::fhog_filterbank> banks(detector.num_detectors());
+    for (unsigned long i = 0; i < banks.size(); i++)
+        banks[i] = detector.get_scanner().build_fhog_filterbank(detector.get_w(i));
+    return banks;
+}
+
+// what detector(img) returns, given the fHOG pyramid of img: every filter scanned over every level, then non-max suppression
+inline std::vector<dlib::rectangle> detectInPyramid(const dlib::frontal_face_detector &detector, const std::vector<fhog_scanner::fhog_filterbank> &banks,
+                                                    const fhog_params &p, const fhog_pyramid &pyramid) {
+    const fhog_scanner &scanner = detector.get_scanner();
+    std::vector<dlib::rect_detection> found;
+    std::vector<std::pair<double, dlib::rectangle> > dets;
+    for (unsigned long i = 0; i < banks.size(); i++) {
+        const double thresh = detector.get_w(i)(scanner.get_num_dimensions());
+        dlib::impl::detect_from_fhog_pyramid<fhog_pyramid_type>(pyramid.feats, scanner.get_feature_extractor(), banks[i], thresh,
+                                                                p.box_rows, p.box_cols, p.cell_size, p.filter_rows, p.filter_cols, dets);
+        for (const auto &d : dets) {
+            dlib::rect_detection det;
+            det.detection_confidence = d.first - thresh;
+            det.weight_index = i;
+            det.rect = d.second;
+            found.push_back(det);
+        }
+    }
+    std::sort(found.rbegin(), found.rend());
+    std::vector<dlib::rectangle> kept;
+    for (const dlib::rect_detection &det : found)
+        if (std::none_of(kept.begin(), kept.end(), [&](const dlib::rectangle &k){
+                return detector.get_overlap_tester()(k, det.rect);
+            }))
+            kept.push_back(det.rect);
+    return kept;
+}
+
+} // namespace examples
+} // namespace ndn
+
+#endif // REUSE_EDGE_FHOG_REUSE_HPP
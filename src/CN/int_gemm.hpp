@@ -0,0 +1,245 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2013-2018 Regents of the University of California.
+ *
+ * This file is part of ndn-cxx library (NDN C++ library with eXperimental eXtensions).
+ *
+ * ndn-cxx library is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later version.
+ *
+ * ndn-cxx library is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more details.
+ *
+ * You should have received copies of the GNU General Public License and GNU Lesser
+ * General Public License along with ndn-cxx, e.g., in COPYING.md file.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * See AUTHORS.md for complete list of ndn-cxx authors and contributors.
+ */
+
+#ifndef REUSE_EDGE_INT_GEMM_HPP
+#define REUSE_EDGE_INT_GEMM_HPP
+
+#include <../eigen/Eigen/Dense>
+
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#if defined(__AVX512F__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include "work_pool.hpp"
+
+namespace ndn {
+namespace examples {
+
+// which kernel multiplies the int32 matrices
+enum class gemm_backend {
+    // Eigen's own product, single-threaded (what the CN always used)
+    eigen,
+    // cache-blocked kernel below, vectorized with AVX-512/AVX2 if the build targets them
+    blocked
+};
+
+inline gemm_backend gemmBackendFromString(const std::string &name) {
+    if (name == "eigen")
+        return gemm_backend::eigen;
+    if (name == "blocked")
+        return gemm_backend::blocked;
+    throw std::invalid_argument("unknown gemm backend " + name);
+}
+
+// name of the SIMD instruction set the blocked kernel was compiled for
+inline const char *gemmIsa() {
+#if defined(__AVX512F__)
+    return "avx512";
+#elif defined(__AVX2__)
+    return "avx2";
+#else
+    return "scalar";
+#endif
+}
+
+// int32 matrix product for the matrix CN
+// the blocked kernel splits C into column panels; a panel is computed block by block so that a KC x MC block of A
+// stays in L2 while four columns of C are accumulated in registers; products wrap around modulo 2^32 exactly like
+// Eigen's (the arithmetic is done unsigned, so the wrapping is well-defined)
+// when some of the pool's workers are idle and the product is big enough, the panels are shared with them; the
+// calling thread always works too, so a busy CN never waits for help
+class int_gemm {
+    public:
+        int_gemm(gemm_backend backend, work_pool *pool) : backend_(backend), pool_(pool) {}
+
+        gemm_backend backend() const {
+            return backend_;
+        }
+
+        // c = a * b (c must not alias a or b)
+        void multiply(const Eigen::Ref<const Eigen::MatrixXi> &a, const Eigen::Ref<const Eigen::MatrixXi> &b, Eigen::MatrixXi &c) const {
+            if (backend_ == gemm_backend::eigen || a.rows() < SMALL || b.cols() < SMALL) {
+                c.noalias() = a * b;
+                return;
+            }
+            c.resize(a.rows(), b.cols());
+            std::shared_ptr<job> j = std::make_shared<job>();
+            j->a = a.data();
+            j->b = b.data();
+            j->c = c.data();
+            j->m = a.rows();
+            j->k = a.cols();
+            j->n = b.cols();
+            j->lda = a.outerStride();
+            j->ldb = b.outerStride();
+            j->ldc = c.outerStride();
+            j->panels = (j->n + NC - 1) / NC;
+            // hand panels to idle workers only if there's enough work for more than one of them
+            if (pool_ && j->panels > 1 && static_cast<long>(j->m) * j->k * j->n >= PARALLEL_OPS) {
+                std::size_t helpers = std::min<std::size_t>(pool_->idle(), j->panels - 1);
+                for (std::size_t i = 0; i < helpers; i++)
+                    pool_->submit([j]{
+                        j->work();
+                    });
+            }
+            j->work();
+            // wait for panels other threads have claimed but not finished yet
+            std::unique_lock<std::mutex> lk(j->m_);
+            j->cv_.wait(lk, [&]{
+                return j->finished == j->panels;
+            });
+        }
+
+    private:
+        // below this the blocking and the threads cost more than they save
+        static constexpr int SMALL = 64;
+        static constexpr long PARALLEL_OPS = 256L * 256 * 256;
+        // panel width (columns of C per task), rows of A per block, depth of A per block
+        static constexpr int NC = 64;
+        static constexpr int MC = 256;
+        static constexpr int KC = 256;
+
+        // one product being computed; helpers that start after it is done find no panel left and return
+        struct job {
+            const int *a;
+            const int *b;
+            int *c;
+            int m, k, n;
+            long lda, ldb, ldc;
+            int panels;
+            std::atomic<int> next{0};
+            int finished = 0;
+            std::mutex m_;
+            std::condition_variable cv_;
+
+            void work() {
+                for (int p; (p = next++) < panels;) {
+                    panel(p * NC, std::min(n, p * NC + NC));
+                    std::lock_guard<std::mutex> lk(m_);
+                    if (++finished == panels)
+                        cv_.notify_all();
+                }
+            }
+
+            void panel(int j0, int j1) {
+                for (int j = j0; j < j1; j++)
+                    std::fill(c + j * ldc, c + j * ldc + m, 0);
+                for (int p0 = 0; p0 < k; p0 += KC) {
+                    int p1 = std::min(k, p0 + KC);
+                    for (int i0 = 0; i0 < m; i0 += MC) {
+                        int i1 = std::min(m, i0 + MC);
+                        int j = j0;
+                        for (; j + 4 <= j1; j += 4)
+                            block4(i0, i1, p0, p1, j);
+                        for (; j < j1; j++)
+                            block1(i0, i1, p0, p1, j);
+                    }
+                }
+            }
+
+            // c(i0:i1, j:j+4) += a(i0:i1, p0:p1) * b(p0:p1, j:j+4)
+            void block4(int i0, int i1, int p0, int p1, int j) {
+                std::uint32_t *c0 = reinterpret_cast<std::uint32_t *>(c + j * ldc);
+                std::uint32_t *c1 = c0 + ldc, *c2 = c1 + ldc, *c3 = c2 + ldc;
+                const std::uint32_t *b0 = reinterpret_cast<const std::uint32_t *>(b + j * ldb);
+                const std::uint32_t *b1 = b0 + ldb, *b2 = b1 + ldb, *b3 = b2 + ldb;
+                int i = i0;
+#if defined(__AVX512F__)
+                for (; i + 16 <= i1; i += 16) {
+                    __m512i s0 = _mm512_loadu_si512(c0 + i), s1 = _mm512_loadu_si512(c1 + i);
+                    __m512i s2 = _mm512_loadu_si512(c2 + i), s3 = _mm512_loadu_si512(c3 + i);
+                    for (int p = p0; p < p1; p++) {
+                        __m512i av = _mm512_loadu_si512(a + p * lda + i);
+                        s0 = _mm512_add_epi32(s0, _mm512_mullo_epi32(av, _mm512_set1_epi32(b0[p])));
+                        s1 = _mm512_add_epi32(s1, _mm512_mullo_epi32(av, _mm512_set1_epi32(b1[p])));
+                        s2 = _mm512_add_epi32(s2, _mm512_mullo_epi32(av, _mm512_set1_epi32(b2[p])));
+                        s3 = _mm512_add_epi32(s3, _mm512_mullo_epi32(av, _mm512_set1_epi32(b3[p])));
+                    }
+                    _mm512_storeu_si512(c0 + i, s0);
+                    _mm512_storeu_si512(c1 + i, s1);
+                    _mm512_storeu_si512(c2 + i, s2);
+                    _mm512_storeu_si512(c3 + i, s3);
+                }
+#endif
+#if defined(__AVX2__)
+                for (; i + 8 <= i1; i += 8) {
+                    __m256i s0 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(c0 + i));
+                    __m256i s1 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(c1 + i));
+                    __m256i s2 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(c2 + i));
+                    __m256i s3 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(c3 + i));
+                    for (int p = p0; p < p1; p++) {
+                        __m256i av = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + p * lda + i));
+                        s0 = _mm256_add_epi32(s0, _mm256_mullo_epi32(av, _mm256_set1_epi32(b0[p])));
+                        s1 = _mm256_add_epi32(s1, _mm256_mullo_epi32(av, _mm256_set1_epi32(b1[p])));
+                        s2 = _mm256_add_epi32(s2, _mm256_mullo_epi32(av, _mm256_set1_epi32(b2[p])));
+                        s3 = _mm256_add_epi32(s3, _mm256_mullo_epi32(av, _mm256_set1_epi32(b3[p])));
+                    }
+                    _mm256_storeu_si256(reinterpret_cast<__m256i *>(c0 + i), s0);
+                    _mm256_storeu_si256(reinterpret_cast<__m256i *>(c1 + i), s1);
+                    _mm256_storeu_si256(reinterpret_cast<__m256i *>(c2 + i), s2);
+                    _mm256_storeu_si256(reinterpret_cast<__m256i *>(c3 + i), s3);
+                }
+#endif
+                // rows left over (all of them without SIMD): plain loop over the same block, which compilers vectorize
+                for (int p = p0; p < p1; p++) {
+                    const std::uint32_t *ap = reinterpret_cast<const std::uint32_t *>(a + p * lda);
+                    std::uint32_t v0 = b0[p], v1 = b1[p], v2 = b2[p], v3 = b3[p];
+                    for (int r = i; r < i1; r++) {
+                        c0[r] += ap[r] * v0;
+                        c1[r] += ap[r] * v1;
+                        c2[r] += ap[r] * v2;
+                        c3[r] += ap[r] * v3;
+                    }
+                }
+            }
+
+            // single column left over at the right edge of a panel
+            void block1(int i0, int i1, int p0, int p1, int j) {
+                std::uint32_t *cj = reinterpret_cast<std::uint32_t *>(c + j * ldc);
+                const std::uint32_t *bj = reinterpret_cast<const std::uint32_t *>(b + j * ldb);
+                for (int p = p0; p < p1; p++) {
+                    const std::uint32_t *ap = reinterpret_cast<const std::uint32_t *>(a + p * lda);
+                    std::uint32_t v = bj[p];
+                    for (int r = i0; r < i1; r++)
+                        cj[r] += ap[r] * v;
+                }
+            }
+        };
+
+        gemm_backend backend_;
+        work_pool *pool_;
+};
+
+} // namespace examples
+} // namespace ndn
+
+#endif // REUSE_EDGE_INT_GEMM_HPP
@@ -0,0 +1,249 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2013-2018 Regents of the University of California.
+ *
+ * This file is part of ndn-cxx library (NDN C++ library with eXperimental eXtensions).
+ *
+ * ndn-cxx library is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later version.
+ *
+ * ndn-cxx library is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more details.
+ *
+ * You should have received copies of the GNU General Public License and GNU Lesser
+ * General Public License along with ndn-cxx, e.g., in COPYING.md file.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * See AUTHORS.md for complete list of ndn-cxx authors and contributors.
+ */
+
+
+#ifndef REUSE_EDGE_MATRIX_CANON_HPP
+#define REUSE_EDGE_MATRIX_CANON_HPP
+
+#include <../eigen/Eigen/Dense>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// canonical form of a matrix for reuse lookups, shared by the CN and the matrix consumer
+// A = scale * B, or scale * B^T if transposed, where B has no common integer factor, its first nonzero element (in
+// column-major order) is positive, and it is the smaller of itself and its transpose
+// since (cA)^e = c^e A^e and (A^T)^e = (A^e)^T, every A with the same B shares the cached powers of B; the consumer
+// keys its request by the digest of B and names the transform:
+//   /edge-compute/computer/<id>/multiply/<dim>/<exp>/<digest of B>/<scale>/<0|1 transposed>/<structure>
+// structured B have a closed-form power, so the CN answers them in O(dim^2) without multiplying (and without fetching
+// the matrix at all for constant and identity B, which dim and scale describe completely)
+
+namespace ndn {
+namespace examples {
+
+enum matrix_structure {
+    STRUCTURE_GENERAL,
+    // every element 1 (all elements of A equal; the zero matrix is scale 0)
+    STRUCTURE_CONSTANT,
+    STRUCTURE_IDENTITY,
+    STRUCTURE_DIAGONAL,
+    STRUCTURE_PERMUTATION
+};
+
+inline const char *structureName(matrix_structure s) {
+    switch (s) {
+        case STRUCTURE_CONSTANT:
+            return "constant";
+        case STRUCTURE_IDENTITY:
+            return "identity";
+        case STRUCTURE_DIAGONAL:
+            return "diagonal";
+        case STRUCTURE_PERMUTATION:
+            return "permutation";
+        default:
+            return "general";
+    }
+}
+
+// unknown names are general, which is always correct
+inline matrix_structure structureFromName(const std::string &name) {
+    for (matrix_structure s : {STRUCTURE_CONSTANT, STRUCTURE_IDENTITY, STRUCTURE_DIAGONAL, STRUCTURE_PERMUTATION})
+        if (name == structureName(s))
+            return s;
+    return STRUCTURE_GENERAL;
+}
+
+// whether dim and scale alone describe B, so the matrix never has to be fetched
+inline bool structureNeedsNoData(matrix_structure s) {
+    return s == STRUCTURE_CONSTANT || s == STRUCTURE_IDENTITY;
+}
+
+// the transform from B back to A, as carried in the request name
+struct canonical_params {
+    std::int32_t scale;
+    bool transposed;
+    matrix_structure structure;
+
+    canonical_params() : scale(1), transposed(false), structure(STRUCTURE_GENERAL) {}
+};
+
+struct canonical_form {
+    canonical_params params;
+    Eigen::MatrixXi mat;
+};
+
+inline matrix_structure detectStructure(const Eigen::MatrixXi &b) {
+    if (b.rows() != b.cols() || !b.size())
+        return STRUCTURE_GENERAL;
+    if ((b.array() == 1).all())
+        return STRUCTURE_CONSTANT;
+    bool diagonal = true;
+    bool permutation = true;
+    for (int c = 0; c < b.cols() && (diagonal || permutation); c++) {
+        int ones = 0;
+        for (int r = 0; r < b.rows(); r++) {
+            int v = b(r, c);
+            if (v && r != c)
+                diagonal = false;
+            if (v == 1)
+                ones++;
+            else if (v)
+                permutation = false;
+        }
+        if (ones != 1)
+            permutation = false;
+    }
+    if (diagonal && permutation)
+        return STRUCTURE_IDENTITY;
+    if (diagonal)
+        return STRUCTURE_DIAGONAL;
+    // one 1 per column; a permutation also needs one per row
+    if (permutation && ((b.rowwise().sum().array() == 1).all()))
+        return STRUCTURE_PERMUTATION;
+    return STRUCTURE_GENERAL;
+}
+
+// O(dim^2): one pass for the common factor, one to divide it out, one to compare against the transpose
+inline canonical_form canonicalize(const Eigen::MatrixXi &a) {
+    canonical_form cf;
+    std::uint64_t g = 0;
+    for (Eigen::Index i = 0; i < a.size(); i++)
+        g = std::gcd(g, static_cast<std::uint64_t>(std::llabs(static_cast<std::int64_t>(a.data()[i]))));
+    if (!g) {
+        // the zero matrix: 0 * (all ones)
+        cf.params.scale = 0;
+        cf.mat = Eigen::MatrixXi::Ones(a.rows(), a.cols());
+        cf.params.structure = detectStructure(cf.mat);
+        return cf;
+    }
+    // sign of the first nonzero element of A and of A^T (the first nonzero of A's rows), each in column-major order
+    auto firstSign = [](const Eigen::MatrixXi &m, bool rows){
+        for (int i = 0; i < (rows ? m.rows() : m.cols()); i++)
+            for (int j = 0; j < (rows ? m.cols() : m.rows()); j++) {
+                int v = rows ? m(i, j) : m(j, i);
+                if (v)
+                    return v < 0 ? -1 : 1;
+            }
+        return 1;
+    };
+    int sign = firstSign(a, false);
+    if (a.rows() == a.cols()) {
+        // take the transpose if, once both are made to start positive, its column-major elements compare smaller
+        int sign_t = firstSign(a, true);
+        int n = a.rows();
+        int cmp = 0;
+        for (int c = 0; c < n && !cmp; c++)
+            for (int r = 0; r < n && !cmp; r++) {
+                std::int64_t v = static_cast<std::int64_t>(sign) * a(r, c);
+                std::int64_t t = static_cast<std::int64_t>(sign_t) * a(c, r);
+                if (v != t)
+                    cmp = t < v ? -1 : 1;
+            }
+        if (cmp < 0) {
+            cf.params.transposed = true;
+            sign = sign_t;
+        }
+    }
+    std::int64_t scale = sign * static_cast<std::int64_t>(g);
+    cf.params.scale = static_cast<std::int32_t>(scale);
+    if (cf.params.transposed)
+        cf.mat = a.transpose();
+    else
+        cf.mat = a;
+    if (scale != 1)
+        cf.mat = cf.mat.unaryExpr([scale](int v){
+            return static_cast<int>(v / scale);
+        });
+    cf.params.structure = detectStructure(cf.mat);
+    return cf;
+}
+
+// v^e modulo 2^32, the same wraparound the CN's products have
+inline std::uint32_t powWrap(std::uint32_t v, int e) {
+    std::uint32_t r = 1;
+    for (; e > 0; e >>= 1) {
+        if (e & 1)
+            r *= v;
+        v *= v;
+    }
+    return r;
+}
+
+// (scale * B)^e for a structured B (e > 0), in O(dim^2) instead of O(log e) dense products; to get A^e, transpose the
+// result if params.transposed
+inline Eigen::MatrixXi closedFormPower(const Eigen::MatrixXi &b, const canonical_params &params, int e) {
+    int n = b.rows();
+    std::uint32_t s = powWrap(static_cast<std::uint32_t>(params.scale), e);
+    auto wrap = [](std::uint32_t v){
+        return static_cast<int>(v);
+    };
+    switch (params.structure) {
+        case STRUCTURE_CONSTANT:
+            // J^e = n^(e-1) J
+            return Eigen::MatrixXi::Constant(n, n, wrap(s * powWrap(n, e - 1)));
+        case STRUCTURE_IDENTITY:
+            return Eigen::MatrixXi::Identity(n, n) * wrap(s);
+        case STRUCTURE_DIAGONAL: {
+            Eigen::MatrixXi res = Eigen::MatrixXi::Zero(n, n);
+            for (int i = 0; i < n; i++)
+                res(i, i) = wrap(s * powWrap(static_cast<std::uint32_t>(b(i, i)), e));
+            return res;
+        }
+        case STRUCTURE_PERMUTATION: {
+            // column j of B has its 1 in row to[j]; walk every cycle once and step e places along it
+            std::vector<int> to(n);
+            for (int c = 0; c < n; c++)
+                for (int r = 0; r < n; r++)
+                    if (b(r, c))
+                        to[c] = r;
+            Eigen::MatrixXi res = Eigen::MatrixXi::Zero(n, n);
+            std::vector<bool> seen(n, false);
+            std::vector<int> cycle;
+            for (int start = 0; start < n; start++) {
+                if (seen[start])
+                    continue;
+                cycle.clear();
+                for (int j = start; !seen[j]; j = to[j]) {
+                    seen[j] = true;
+                    cycle.push_back(j);
+                }
+                std::size_t len = cycle.size();
+                for (std::size_t i = 0; i < len; i++)
+                    res(cycle[(i + e % len) % len], cycle[i]) = wrap(s);
+            }
+            return res;
+        }
+        default:
+            throw std::logic_error("no closed form for a general matrix");
+    }
+}
+
+} // namespace examples
+} // namespace ndn
+
+#endif // REUSE_EDGE_MATRIX_CANON_HPP
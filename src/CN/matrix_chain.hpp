@@ -0,0 +1,124 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2013-2018 Regents of the University of California.
+ *
+ * This file is part of ndn-cxx library (NDN C++ library with eXperimental eXtensions).
+ *
+ * ndn-cxx library is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later version.
+ *
+ * ndn-cxx library is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more details.
+ *
+ * You should have received copies of the GNU General Public License and GNU Lesser
+ * General Public License along with ndn-cxx, e.g., in COPYING.md file.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * See AUTHORS.md for complete list of ndn-cxx authors and contributors.
+ */
+
+
+#ifndef REUSE_EDGE_MATRIX_CHAIN_HPP
+#define REUSE_EDGE_MATRIX_CHAIN_HPP
+
+#include <ndn-cxx/util/sha256.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "reuse_store.hpp"
+
+namespace ndn {
+namespace examples {
+
+// matrix chains: /edge-compute/computer/<id>/chain/<p0,p1,...,pn>/<digest of A_1>/.../<digest of A_n>
+// asks for A_1 A_2 ... A_n, where A_k is p(k-1) x p(k); operands the reuse table lacks are fetched from the requester
+// by digest (/edge-compute/requester/<id>/operand/<digest>/<beg>/<end>/...), and every subproduct the chain computes is
+// cached under the digest of the operands it multiplies, so later chains sharing a run of operands start from it
+
+// digest the subproduct A_i ... A_j (0-based, inclusive) is cached under: SHA-256 over the operand digests in order,
+// behind a tag so it can never collide with the digest of a matrix; a single operand is its own digest
+inline matrix_digest chainDigest(const std::vector<matrix_digest> &operands, int i, int j) {
+    if (i == j)
+        return operands[i];
+    util::Sha256 sha;
+    static const char tag[] = "chain";
+    sha.update(reinterpret_cast<const std::uint8_t *>(tag), sizeof(tag));
+    for (int k = i; k <= j; k++)
+        sha.update(operands[k].data(), operands[k].size());
+    ConstBufferPtr buf = sha.computeDigest();
+    matrix_digest d;
+    std::copy(buf->begin(), buf->end(), d.begin());
+    return d;
+}
+
+// order to multiply a chain in: the classic O(n^3) dynamic program over parenthesizations, except that subproducts we
+// have cached cost nothing
+struct chain_plan {
+    int n;
+    // the product of i..j is (i..k)(k+1..j) with k = split[i * n + j]; -1 if it is a single operand or cached
+    std::vector<int> split;
+    // scalar multiplications left to do
+    double cost;
+
+    int at(int i, int j) const {
+        return split[i * n + j];
+    }
+};
+
+// dims holds p0..pn; cached(i, j) tells whether the subproduct i..j (i < j) is in the reuse table
+template <typename Cached>
+chain_plan planChain(const std::vector<int> &dims, Cached cached) {
+    chain_plan plan;
+    plan.n = dims.size() - 1;
+    int n = plan.n;
+    plan.split.assign(n * n, -1);
+    std::vector<double> cost(n * n, 0);
+    for (int len = 2; len <= n; len++)
+        for (int i = 0; i + len - 1 < n; i++) {
+            int j = i + len - 1;
+            if (cached(i, j))
+                continue;
+            double best = std::numeric_limits<double>::infinity();
+            for (int k = i; k < j; k++) {
+                double c = cost[i * n + k] + cost[(k + 1) * n + j] + static_cast<double>(dims[i]) * dims[k + 1] * dims[j + 1];
+                if (c < best) {
+                    best = c;
+                    plan.split[i * n + j] = k;
+                }
+            }
+            cost[i * n + j] = best;
+        }
+    plan.cost = cost[n - 1];
+    return plan;
+}
+
+// parses "p0,p1,...,pn" (at least one operand, every dimension positive); throws std::invalid_argument
+inline std::vector<int> chainDimsFromString(const std::string &spec) {
+    std::vector<int> dims;
+    for (std::size_t at = 0; at <= spec.size();) {
+        std::size_t comma = spec.find(',', at);
+        if (comma == std::string::npos)
+            comma = spec.size();
+        int p = std::atoi(spec.substr(at, comma - at).c_str());
+        if (p <= 0)
+            throw std::invalid_argument("bad chain dimensions " + spec);
+        dims.push_back(p);
+        at = comma + 1;
+    }
+    if (dims.size() < 2)
+        throw std::invalid_argument("a chain needs at least one operand: " + spec);
+    return dims;
+}
+
+} // namespace examples
+} // namespace ndn
+
+#endif // REUSE_EDGE_MATRIX_CHAIN_HPP
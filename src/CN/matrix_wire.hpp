@@ -0,0 +1,218 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2013-2018 Regents of the University of California.
+ *
+ * This file is part of ndn-cxx library (NDN C++ library with eXperimental eXtensions).
+ *
+ * ndn-cxx library is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later version.
+ *
+ * ndn-cxx library is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more details.
+ *
+ * You should have received copies of the GNU General Public License and GNU Lesser
+ * General Public License along with ndn-cxx, e.g., in COPYING.md file.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * See AUTHORS.md for complete list of ndn-cxx authors and contributors.
+ */
+
+#ifndef REUSE_EDGE_MATRIX_WIRE_HPP
+#define REUSE_EDGE_MATRIX_WIRE_HPP
+
+#include <../eigen/Eigen/Dense>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <stdexcept>
+
+#if !defined(__BYTE_ORDER__) || __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "binary matrix segments carry little-endian integers and are only supported on little-endian hosts"
+#endif
+
+// binary wire format of a block of matrix rows, shared by the CN (decoding) and the matrix consumer (encoding)
+// negotiation: the CN appends WIRE_BINARY_COMPONENT to the name of every segment Interest it sends; a consumer that
+// understands it answers with a binary segment, anything else answers with the old text rows ("1,2,3|4,5,6|")
+// text never starts with a NUL byte, so the first byte of the content tells the two apart
+#define WIRE_BINARY_COMPONENT "bin1"
+// appended after WIRE_BINARY_COMPONENT by a CN that also decodes SEGMENT_SPARSE; consumers only use it when they see it
+#define WIRE_SPARSE_COMPONENT "sparse"
+
+namespace ndn {
+namespace examples {
+
+enum segment_encoding : std::uint8_t {
+    // little-endian int32 elements, row by row
+    SEGMENT_RAW = 0,
+    // zigzag LEB128 varints, row by row (small magnitudes take a byte or two instead of four)
+    SEGMENT_ZIGZAG = 1,
+    // compressed rows: per row a varint count of its nonzeros, then for each of them a varint column gap (from one past
+    // the previous nonzero's column) and its zigzag varint value
+    SEGMENT_SPARSE = 2
+};
+
+// 16-byte header in front of every binary segment, all fields little-endian
+struct segment_header {
+    // always 0, which a text segment can never start with
+    std::uint8_t marker;
+    std::uint8_t version;
+    std::uint8_t encoding;
+    std::uint8_t reserved;
+    // rows [beg_row, end_row) of the matrix, each cols elements long
+    std::uint32_t beg_row;
+    std::uint32_t end_row;
+    std::uint32_t cols;
+};
+static_assert(sizeof(segment_header) == 16, "segment header must stay 16 bytes");
+
+const std::uint8_t SEGMENT_VERSION = 1;
+
+inline bool isBinarySegment(const std::uint8_t *buf, std::size_t len) {
+    return len >= sizeof(segment_header) && buf[0] == 0;
+}
+
+inline std::uint32_t zigzag(std::int32_t v) {
+    return (static_cast<std::uint32_t>(v) << 1) ^ static_cast<std::uint32_t>(v >> 31);
+}
+
+inline std::int32_t unzigzag(std::uint32_t v) {
+    return static_cast<std::int32_t>((v >> 1) ^ (~(v & 1) + 1));
+}
+
+inline std::size_t varintSize(std::uint32_t v) {
+    std::size_t n = 1;
+    while (v >= 0x80) {
+        v >>= 7;
+        n++;
+    }
+    return n;
+}
+
+inline std::uint8_t *putVarint(std::uint8_t *p, std::uint32_t v) {
+    while (v >= 0x80) {
+        *p++ = static_cast<std::uint8_t>(v | 0x80);
+        v >>= 7;
+    }
+    *p++ = static_cast<std::uint8_t>(v);
+    return p;
+}
+
+inline std::uint32_t getVarint(const std::uint8_t *&p, const std::uint8_t *e) {
+    std::uint32_t v = 0;
+    for (int shift = 0;; shift += 7) {
+        if (p == e || shift > 28)
+            throw std::runtime_error("truncated varint in matrix segment");
+        v |= static_cast<std::uint32_t>(*p & 0x7f) << shift;
+        if (!(*p++ & 0x80))
+            return v;
+    }
+}
+
+// encodes rows [beg, end) of m, picking whichever of raw, zigzag and (if the CN takes it) sparse is smallest
+inline std::string encodeSegment(const Eigen::MatrixXi &m, int beg, int end, bool sparse_ok = false) {
+    segment_header h = {0, SEGMENT_VERSION, SEGMENT_RAW, 0, static_cast<std::uint32_t>(beg), static_cast<std::uint32_t>(end), static_cast<std::uint32_t>(m.cols())};
+    std::size_t raw = static_cast<std::size_t>(end - beg) * m.cols() * sizeof(std::int32_t);
+    std::size_t packed = 0;
+    std::size_t sparse = 0;
+    for (int r = beg; r < end; r++) {
+        std::uint32_t nnz = 0;
+        for (int c = 0, last = -1; c < m.cols(); c++) {
+            std::uint32_t v = zigzag(m(r, c));
+            packed += varintSize(v);
+            if (v) {
+                sparse += varintSize(c - last - 1) + varintSize(v);
+                last = c;
+                nnz++;
+            }
+        }
+        sparse += varintSize(nnz);
+    }
+    std::size_t size = raw;
+    if (packed < size) {
+        h.encoding = SEGMENT_ZIGZAG;
+        size = packed;
+    }
+    if (sparse_ok && sparse < size) {
+        h.encoding = SEGMENT_SPARSE;
+        size = sparse;
+    }
+    std::string out(sizeof(h) + size, '\0');
+    std::memcpy(&out[0], &h, sizeof(h));
+    std::uint8_t *p = reinterpret_cast<std::uint8_t *>(&out[sizeof(h)]);
+    if (h.encoding == SEGMENT_SPARSE) {
+        for (int r = beg; r < end; r++) {
+            std::uint32_t nnz = 0;
+            for (int c = 0; c < m.cols(); c++)
+                nnz += m(r, c) != 0;
+            p = putVarint(p, nnz);
+            for (int c = 0, last = -1; c < m.cols(); c++)
+                if (m(r, c)) {
+                    p = putVarint(p, c - last - 1);
+                    p = putVarint(p, zigzag(m(r, c)));
+                    last = c;
+                }
+        }
+        return out;
+    }
+    for (int r = beg; r < end; r++)
+        for (int c = 0; c < m.cols(); c++) {
+            if (h.encoding == SEGMENT_RAW) {
+                std::int32_t v = m(r, c);
+                std::memcpy(p, &v, sizeof(v));
+                p += sizeof(v);
+            } else
+                p = putVarint(p, zigzag(m(r, c)));
+        }
+    return out;
+}
+
+// decodes a binary segment straight into its rows of m (which must already have the full size)
+// returns the number of rows written; throws std::runtime_error if the segment is malformed or does not fit m
+inline int decodeSegment(const std::uint8_t *buf, std::size_t len, Eigen::MatrixXi &m) {
+    segment_header h;
+    if (!isBinarySegment(buf, len))
+        throw std::runtime_error("not a binary matrix segment");
+    std::memcpy(&h, buf, sizeof(h));
+    if (h.version != SEGMENT_VERSION)
+        throw std::runtime_error("unsupported matrix segment version " + std::to_string(h.version));
+    if (h.cols != static_cast<std::uint32_t>(m.cols()) || h.beg_row > h.end_row || h.end_row > static_cast<std::uint32_t>(m.rows()))
+        throw std::runtime_error("matrix segment rows " + std::to_string(h.beg_row) + '-' + std::to_string(h.end_row) + " do not fit the matrix");
+    const std::uint8_t *p = buf + sizeof(h);
+    const std::uint8_t *e = buf + len;
+    int rows = h.end_row - h.beg_row;
+    if (h.encoding == SEGMENT_RAW) {
+        if (static_cast<std::size_t>(e - p) != static_cast<std::size_t>(rows) * h.cols * sizeof(std::int32_t))
+            throw std::runtime_error("truncated raw matrix segment");
+        // the payload is row-major and possibly unaligned; Eigen transposes it into the column-major rows
+        m.middleRows(h.beg_row, rows) = Eigen::Map<const Eigen::Matrix<int, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>, Eigen::Unaligned>(reinterpret_cast<const int *>(p), rows, h.cols);
+    } else if (h.encoding == SEGMENT_ZIGZAG) {
+        for (int r = h.beg_row; r < static_cast<int>(h.end_row); r++)
+            for (int c = 0; c < static_cast<int>(h.cols); c++)
+                m(r, c) = unzigzag(getVarint(p, e));
+    } else if (h.encoding == SEGMENT_SPARSE) {
+        m.middleRows(h.beg_row, rows).setZero();
+        for (int r = h.beg_row; r < static_cast<int>(h.end_row); r++) {
+            std::uint32_t nnz = getVarint(p, e);
+            if (nnz > h.cols)
+                throw std::runtime_error("sparse matrix segment row holds more elements than columns");
+            std::uint32_t c = 0;
+            for (std::uint32_t i = 0; i < nnz; i++, c++) {
+                c += getVarint(p, e);
+                if (c >= h.cols)
+                    throw std::runtime_error("sparse matrix segment column out of range");
+                m(r, c) = unzigzag(getVarint(p, e));
+            }
+        }
+    } else
+        throw std::runtime_error("unknown matrix segment encoding " + std::to_string(h.encoding));
+    return rows;
+}
+
+} // namespace examples
+} // namespace ndn
+
+#endif // REUSE_EDGE_MATRIX_WIRE_HPP
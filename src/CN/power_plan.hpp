@@ -0,0 +1,174 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2013-2018 Regents of the University of California.
+ *
+ * This file is part of ndn-cxx library (NDN C++ library with eXperimental eXtensions).
+ *
+ * ndn-cxx library is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later version.
+ *
+ * ndn-cxx library is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more details.
+ *
+ * You should have received copies of the GNU General Public License and GNU Lesser
+ * General Public License along with ndn-cxx, e.g., in COPYING.md file.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * See AUTHORS.md for complete list of ndn-cxx authors and contributors.
+ */
+
+#ifndef REUSE_EDGE_POWER_PLAN_HPP
+#define REUSE_EDGE_POWER_PLAN_HPP
+
+#include <cstddef>
+#include <cstdlib>
+#include <vector>
+#include <set>
+#include <string>
+#include <stdexcept>
+#include <algorithm>
+
+namespace ndn {
+namespace examples {
+
+// plan for computing A^exponent out of the powers of A that are already in the reuse table
+// the result is the product of the factors; every factor is either a cached power or a power of two
+// produced by the squaring chain square_from -> 2 * square_from -> ... -> square_to
+struct power_plan {
+    // exponents multiplied together to get the result, in descending order
+    std::vector<int> factors;
+    // power of two the squaring chain starts from (1 is the base matrix itself), 0 if no squaring is needed
+    int square_from;
+    // highest power of two produced by the squaring chain, 0 if no squaring is needed
+    int square_to;
+    // number of dense multiplications the plan costs
+    int multiplies;
+
+    power_plan() : square_from(0), square_to(0), multiplies(0) {}
+};
+
+// returns the highest power of two <= n (n > 0)
+inline int floorPow2(int n) {
+    int p = 1;
+    while (p <= n / 2)
+        p *= 2;
+    return p;
+}
+
+// plans A^exponent given the set of cached exponents (the base matrix, exponent 1, is always available)
+// greedily takes the largest piece that fits into the remaining exponent: a cached power if it is at least as big
+// as the highest power of two that fits, that power of two otherwise; the pieces strictly shrink bitwise, so the
+// plan never costs more than O(log exponent) multiplications, and a cached exponent equal or close to the target
+// is used as-is
+inline power_plan planPower(int exponent, const std::set<int> &cached) {
+    power_plan plan;
+    if (exponent <= 0)
+        return plan;
+    auto isCached = [&](int e){
+        return e == 1 || cached.count(e);
+    };
+    // smallest power of two we have to produce by squaring
+    int lowest_square = 0;
+    for (int rem = exponent; rem > 0;) {
+        int p = floorPow2(rem);
+        // largest cached exponent that fits into what is left
+        int c = 1;
+        auto it = cached.upper_bound(rem);
+        if (it != cached.begin())
+            c = std::max(c, *std::prev(it));
+        int piece = c >= p ? c : p;
+        if (!isCached(piece)) {
+            // squares are taken in descending order, so the first one is the top of the chain
+            if (!plan.square_to)
+                plan.square_to = piece;
+            lowest_square = piece;
+        }
+        plan.factors.push_back(piece);
+        rem -= piece;
+    }
+    if (plan.square_to) {
+        // start the chain from the largest cached power of two below the smallest square we need
+        plan.square_from = 1;
+        for (int p = 2; p < lowest_square; p *= 2)
+            if (isCached(p))
+                plan.square_from = p;
+        // cached powers of two along the chain are loaded instead of squared
+        for (int p = plan.square_from * 2; p <= plan.square_to; p *= 2)
+            if (!isCached(p))
+                plan.multiplies++;
+    }
+    plan.multiplies += plan.factors.size() - 1;
+    return plan;
+}
+
+// what the CN does with reuse disabled: e - 1 multiplications by the base matrix, no squaring (the control the reuse
+// experiments compare against)
+inline power_plan naivePlan(int exponent) {
+    power_plan plan;
+    if (exponent > 1)
+        plan.multiplies = exponent - 1;
+    return plan;
+}
+
+// which of the intermediate powers a multiplication produces are worth caching (the result itself always is)
+enum class checkpoint_mode {
+    // every power runPlan produces: the squares and every partial product
+    every,
+    // only powers of two (the squaring chain), what the CN always cached
+    pow2,
+    // a power only if it is at least ratio times the closest smaller power already cached
+    geometric
+};
+
+struct checkpoint_policy {
+    checkpoint_mode mode;
+    // spacing for geometric
+    double ratio;
+    // at most this many bytes of powers (base matrix included) are cached per matrix, 0 for no limit
+    std::size_t budget_bytes;
+
+    checkpoint_policy() : mode(checkpoint_mode::pow2), ratio(2), budget_bytes(0) {}
+
+    // whether to cache power e; below is the closest smaller power already cached (0 if none)
+    bool keep(int e, int below) const {
+        switch (mode) {
+            case checkpoint_mode::every:
+                return true;
+            case checkpoint_mode::pow2:
+                return (e & (e - 1)) == 0;
+            case checkpoint_mode::geometric:
+                return below <= 0 || e >= below * ratio;
+        }
+        return false;
+    }
+};
+
+// parses "every", "pow2", "geometric[:ratio]" or "budget:<MB>" (every power until the matrix has MB cached)
+inline checkpoint_policy checkpointPolicyFromString(const std::string &spec) {
+    checkpoint_policy policy;
+    std::string mode(spec.substr(0, spec.find(':')));
+    std::string arg(spec.size() > mode.size() ? spec.substr(mode.size() + 1) : "");
+    if (mode == "every" && arg.empty())
+        policy.mode = checkpoint_mode::every;
+    else if (mode == "pow2" && arg.empty())
+        policy.mode = checkpoint_mode::pow2;
+    else if (mode == "geometric") {
+        policy.mode = checkpoint_mode::geometric;
+        if (!arg.empty())
+            policy.ratio = std::atof(arg.c_str());
+        if (policy.ratio <= 1)
+            throw std::invalid_argument("geometric checkpoint ratio must be above 1");
+    } else if (mode == "budget" && std::atoi(arg.c_str()) > 0) {
+        policy.mode = checkpoint_mode::every;
+        policy.budget_bytes = static_cast<std::size_t>(std::atoi(arg.c_str())) << 20;
+    } else
+        throw std::invalid_argument("unknown checkpoint policy " + spec);
+    return policy;
+}
+
+} // namespace examples
+} // namespace ndn
+
+#endif // REUSE_EDGE_POWER_PLAN_HPP
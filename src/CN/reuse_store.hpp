@@ -0,0 +1,602 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2013-2018 Regents of the University of California.
+ *
+ * This file is part of ndn-cxx library (NDN C++ library with eXperimental eXtensions).
+ *
+ * ndn-cxx library is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later version.
+ *
+ * ndn-cxx library is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more details.
+ *
+ * You should have received copies of the GNU General Public License and GNU Lesser
+ * General Public License along with ndn-cxx, e.g., in COPYING.md file.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * See AUTHORS.md for complete list of ndn-cxx authors and contributors.
+ */
+
+#ifndef REUSE_EDGE_REUSE_STORE_HPP
+#define REUSE_EDGE_REUSE_STORE_HPP
+
+#include <ndn-cxx/util/sha256.hpp>
+#include <ndn-cxx/util/string-helper.hpp>
+#include <../eigen/Eigen/Dense>
+#include <../eigen/Eigen/Sparse>
+
+#include <array>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#if !defined(__BYTE_ORDER__) || __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "the reuse store keeps raw little-endian int32 blocks and is only supported on little-endian CNs"
+#endif
+
+namespace ndn {
+namespace examples {
+
+// compressed column-major sparse matrix, the way sparse powers are computed and cached
+typedef Eigen::SparseMatrix<int> sparse_matrix;
+
+// fixed-size content digest of a matrix: SHA-256 over its shape (two little-endian uint32) and raw int32 data
+// consumers compute the same digest and send it (in hex) instead of the matrix when asking for reuse
+typedef std::array<std::uint8_t, 32> matrix_digest;
+
+// the digest is already uniformly distributed, so its first bytes make a fine bucket hash
+struct digest_hash {
+    std::size_t operator()(const matrix_digest &d) const {
+        std::size_t h;
+        std::memcpy(&h, d.data(), sizeof(h));
+        return h;
+    }
+};
+
+inline matrix_digest digestMatrix(const Eigen::MatrixXi &m) {
+    util::Sha256 sha;
+    std::uint32_t shape[2] = {static_cast<std::uint32_t>(m.rows()), static_cast<std::uint32_t>(m.cols())};
+    sha.update(reinterpret_cast<const std::uint8_t *>(shape), sizeof(shape));
+    sha.update(reinterpret_cast<const std::uint8_t *>(m.data()), m.size() * sizeof(int));
+    ConstBufferPtr buf = sha.computeDigest();
+    matrix_digest d;
+    std::copy(buf->begin(), buf->end(), d.begin());
+    return d;
+}
+
+inline std::string digestToHex(const matrix_digest &d) {
+    return toHex(d.data(), d.size(), false);
+}
+
+// parses a hex digest from an interest name; returns false if it is malformed
+inline bool digestFromHex(const std::string &hex, matrix_digest &d) {
+    if (hex.size() != 2 * d.size())
+        return false;
+    auto nibble = [](char c){
+        if (c >= '0' && c <= '9')
+            return c - '0';
+        if (c >= 'a' && c <= 'f')
+            return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F')
+            return c - 'A' + 10;
+        return -1;
+    };
+    for (std::size_t i = 0; i < d.size(); i++) {
+        int hi = nibble(hex[2 * i]);
+        int lo = nibble(hex[2 * i + 1]);
+        if (hi < 0 || lo < 0)
+            return false;
+        d[i] = hi << 4 | lo;
+    }
+    return true;
+}
+
+// on-disk layout of reusables/<digest>.bin
+//   file header (64 bytes): magic "MACR", format version, rows, cols
+//   blocks, one per cached power: 64-byte block header (magic "BLK1", exponent, kind, nonzeros, payload size)
+//   followed by the payload, padded to 64 bytes: either raw little-endian int32 in Eigen's column-major order, or
+//   for a sparse power its compressed columns (int32 column starts [cols + 1], row indices [nnz], values [nnz])
+// every payload starts on a 64-byte boundary of the file, so once mmapped a dense one can be handed to Eigen as is
+// the offset index (exponent -> payload offset) lives in the reuse table; scan() rebuilds it from the block headers
+struct store_file_header {
+    char magic[4];
+    std::uint32_t version;
+    std::uint32_t rows;
+    std::uint32_t cols;
+    std::uint8_t reserved[48];
+};
+
+enum block_kind : std::uint32_t {
+    BLOCK_DENSE = 0,
+    BLOCK_SPARSE = 1
+};
+
+struct store_block_header {
+    char magic[4];
+    std::int32_t exponent;
+    // payload encoding, a block_kind
+    std::uint32_t kind;
+    // nonzero elements of a sparse payload, 0 for a dense one
+    std::uint32_t nnz;
+    std::uint64_t payload_bytes;
+    std::uint8_t reserved[40];
+};
+
+static_assert(sizeof(store_file_header) == 64, "store file header must stay 64 bytes");
+static_assert(sizeof(store_block_header) == 64, "store block header must stay 64 bytes");
+
+// read-only mapping of a store file, shared by every view handed out from it
+class store_mapping {
+    public:
+        store_mapping(int fd, std::size_t length) : base_(nullptr), length_(length) {
+            void *p = mmap(nullptr, length_, PROT_READ, MAP_SHARED, fd, 0);
+            if (p == MAP_FAILED)
+                throw std::runtime_error("failed to mmap reuse store: " + std::string(std::strerror(errno)));
+            base_ = static_cast<const std::uint8_t *>(p);
+        }
+
+        ~store_mapping() {
+            munmap(const_cast<std::uint8_t *>(base_), length_);
+        }
+
+        store_mapping(const store_mapping &) = delete;
+        store_mapping &operator=(const store_mapping &) = delete;
+
+        const std::uint8_t *data() const {
+            return base_;
+        }
+
+        std::size_t size() const {
+            return length_;
+        }
+
+    private:
+        const std::uint8_t *base_;
+        std::size_t length_;
+};
+
+// a cached matrix mapped straight out of the store, no parsing or copying (or one held in memory by the RAM tier)
+// holds on to whatever owns the data, so the pages stay valid even if the store remaps after growing
+struct mapped_matrix {
+    std::shared_ptr<const void> owner;
+    Eigen::Map<const Eigen::MatrixXi> mat;
+
+    mapped_matrix(const std::shared_ptr<const store_mapping> &m, std::size_t offset, int rows, int cols)
+        : owner(m), mat(reinterpret_cast<const int *>(m->data() + offset), rows, cols) {}
+
+    explicit mapped_matrix(const std::shared_ptr<const Eigen::MatrixXi> &m)
+        : owner(m), mat(m->data(), m->rows(), m->cols()) {}
+};
+
+// a power to append to a store, dense or sparse (exactly one of the two is set)
+struct store_block {
+    int exponent;
+    const Eigen::MatrixXi *dense;
+    const sparse_matrix *sparse;
+};
+
+// append-only binary store of the cached powers of one matrix
+class matrix_store {
+    public:
+        // opens the store at path, creating it if needed; throws if an existing file does not hold rows x cols matrices
+        matrix_store(const std::string &path, int rows, int cols) : rows_(rows), cols_(cols) {
+            fd_ = open(path.c_str(), O_RDWR | O_CREAT, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+            if (fd_ < 0)
+                throw std::runtime_error("failed to open reuse store " + path + ": " + std::strerror(errno));
+            struct stat st;
+            fstat(fd_, &st);
+            end_ = st.st_size;
+            if (end_ == 0) {
+                // brand new file, write the header
+                store_file_header h{};
+                std::memcpy(h.magic, "MACR", 4);
+                h.version = 1;
+                h.rows = rows_;
+                h.cols = cols_;
+                writeAt(&h, sizeof(h), 0);
+                end_ = sizeof(h);
+            } else {
+                store_file_header h;
+                if (end_ < sizeof(h) || pread(fd_, &h, sizeof(h), 0) != sizeof(h) || std::memcmp(h.magic, "MACR", 4) || h.version != 1 || static_cast<int>(h.rows) != rows_ || static_cast<int>(h.cols) != cols_) {
+                    close(fd_);
+                    throw std::runtime_error("reuse store " + path + " is corrupt or holds a different shape");
+                }
+            }
+        }
+
+        ~matrix_store() {
+            close(fd_);
+        }
+
+        matrix_store(const matrix_store &) = delete;
+        matrix_store &operator=(const matrix_store &) = delete;
+
+        // bytes taken by one dense payload, padded to the block alignment
+        std::size_t payloadBytes() const {
+            return pad(static_cast<std::size_t>(rows_) * cols_ * sizeof(int));
+        }
+
+        // bytes taken by a sparse payload with nnz nonzeros, padded to the block alignment
+        std::size_t sparsePayloadBytes(std::size_t nnz) const {
+            return pad((static_cast<std::size_t>(cols_) + 1 + 2 * nnz) * sizeof(int));
+        }
+
+        // appends a power of the matrix and returns the offset of its payload
+        std::size_t append(int exponent, const Eigen::MatrixXi &m) {
+            return append({{exponent, &m, nullptr}}).front();
+        }
+
+        // appends a sparse power (which must be compressed) and returns the offset of its payload
+        std::size_t append(int exponent, const sparse_matrix &m) {
+            return append({{exponent, nullptr, &m}}).front();
+        }
+
+        // appends several powers in one sequential write and returns the offsets of their payloads, in order
+        std::vector<std::size_t> append(const std::vector<store_block> &blocks) {
+            static const char zeros[64] = {};
+            std::vector<store_block_header> headers(blocks.size());
+            std::vector<iovec> iov;
+            iov.reserve(blocks.size() * 5);
+            std::vector<std::size_t> offsets;
+            offsets.reserve(blocks.size());
+            std::lock_guard<std::mutex> lock(m_);
+            std::size_t at = end_;
+            for (std::size_t i = 0; i < blocks.size(); i++) {
+                store_block_header &bh = headers[i];
+                std::memcpy(bh.magic, "BLK1", 4);
+                bh.exponent = blocks[i].exponent;
+                iov.push_back({&bh, sizeof(bh)});
+                if (const sparse_matrix *sp = blocks[i].sparse) {
+                    if (!sp->isCompressed())
+                        throw std::logic_error("sparse powers are stored compressed");
+                    bh.kind = BLOCK_SPARSE;
+                    bh.nnz = sp->nonZeros();
+                    std::size_t outer = (static_cast<std::size_t>(sp->outerSize()) + 1) * sizeof(int);
+                    std::size_t inner = static_cast<std::size_t>(bh.nnz) * sizeof(int);
+                    bh.payload_bytes = outer + 2 * inner;
+                    iov.push_back({const_cast<int *>(sp->outerIndexPtr()), outer});
+                    iov.push_back({const_cast<int *>(sp->innerIndexPtr()), inner});
+                    iov.push_back({const_cast<int *>(sp->valuePtr()), inner});
+                } else {
+                    bh.kind = BLOCK_DENSE;
+                    bh.payload_bytes = static_cast<std::size_t>(blocks[i].dense->size()) * sizeof(int);
+                    iov.push_back({const_cast<int *>(blocks[i].dense->data()), bh.payload_bytes});
+                }
+                if (pad(bh.payload_bytes) != bh.payload_bytes)
+                    iov.push_back({const_cast<char *>(zeros), pad(bh.payload_bytes) - bh.payload_bytes});
+                offsets.push_back(at + sizeof(bh));
+                at += sizeof(bh) + pad(bh.payload_bytes);
+            }
+            writeAt(iov, end_);
+            end_ = at;
+            // keep the file size in step with end_ so the last payload's padding is mapped as well
+            if (ftruncate(fd_, end_) < 0)
+                throw std::runtime_error("failed to extend reuse store: " + std::string(std::strerror(errno)));
+            return offsets;
+        }
+
+        // flushes every block appended so far to the disk
+        void sync() {
+            if (fdatasync(fd_) < 0)
+                throw std::runtime_error("failed to sync reuse store: " + std::string(std::strerror(errno)));
+        }
+
+        // whether the block at offset holds a sparse power (see readSparse) rather than a dense one (see view)
+        bool isSparse(std::size_t offset) {
+            store_block_header bh;
+            std::lock_guard<std::mutex> lock(m_);
+            if (offset < sizeof(bh) || pread(fd_, &bh, sizeof(bh), offset - sizeof(bh)) != sizeof(bh))
+                throw std::out_of_range("reuse store offset past the end of the file");
+            return bh.kind == BLOCK_SPARSE;
+        }
+
+        // copies the sparse power at offset out of the mapping (it is small, that's why it is sparse)
+        sparse_matrix readSparse(std::size_t offset) {
+            store_block_header bh;
+            std::shared_ptr<const store_mapping> mapping;
+            {
+                std::lock_guard<std::mutex> lock(m_);
+                if (offset < sizeof(bh) || pread(fd_, &bh, sizeof(bh), offset - sizeof(bh)) != sizeof(bh) || bh.kind != BLOCK_SPARSE
+                    || offset + bh.payload_bytes > end_ || bh.payload_bytes != (static_cast<std::size_t>(cols_) + 1 + 2 * static_cast<std::size_t>(bh.nnz)) * sizeof(int))
+                    throw std::runtime_error("no sparse power at reuse store offset " + std::to_string(offset));
+                if (!mapping_ || mapping_->size() < end_)
+                    mapping_ = std::make_shared<const store_mapping>(fd_, end_);
+                mapping = mapping_;
+            }
+            const int *outer = reinterpret_cast<const int *>(mapping->data() + offset);
+            const int *inner = outer + cols_ + 1;
+            Eigen::Map<const sparse_matrix> m(rows_, cols_, bh.nnz, outer, inner, inner + bh.nnz);
+            return sparse_matrix(m);
+        }
+
+        // maps the payload at offset straight into an Eigen::Map
+        mapped_matrix view(std::size_t offset) {
+            std::lock_guard<std::mutex> lock(m_);
+            if (offset + static_cast<std::size_t>(rows_) * cols_ * sizeof(int) > end_)
+                throw std::out_of_range("reuse store offset past the end of the file");
+            // the file grew past the current mapping, remap it; views still holding the old mapping keep it alive
+            if (!mapping_ || mapping_->size() < end_)
+                mapping_ = std::make_shared<const store_mapping>(fd_, end_);
+            return mapped_matrix(mapping_, offset, rows_, cols_);
+        }
+
+        // rebuilds the offset index (exponent -> payload offset) by walking the block headers
+        std::map<int, std::size_t> scan() {
+            std::map<int, std::size_t> index;
+            std::lock_guard<std::mutex> lock(m_);
+            store_block_header bh;
+            for (std::size_t at = sizeof(store_file_header); at + sizeof(bh) <= end_; at += sizeof(bh) + pad(bh.payload_bytes)) {
+                if (pread(fd_, &bh, sizeof(bh), at) != sizeof(bh) || std::memcmp(bh.magic, "BLK1", 4) || at + sizeof(bh) + bh.payload_bytes > end_)
+                    // torn tail from a crash mid-append, everything before it is still good
+                    break;
+                index[bh.exponent] = at + sizeof(bh);
+            }
+            return index;
+        }
+
+        // checks that a complete block of the given exponent has its payload at offset (used to validate the reuse index)
+        bool holds(std::size_t offset, int exponent) {
+            std::lock_guard<std::mutex> lock(m_);
+            store_block_header bh;
+            return offset >= sizeof(store_file_header) + sizeof(bh) && offset % 64 == 0
+                && pread(fd_, &bh, sizeof(bh), offset - sizeof(bh)) == sizeof(bh) && !std::memcmp(bh.magic, "BLK1", 4)
+                && bh.exponent == exponent
+                && (bh.kind == BLOCK_SPARSE ? bh.payload_bytes == (static_cast<std::size_t>(cols_) + 1 + 2 * static_cast<std::size_t>(bh.nnz)) * sizeof(int)
+                                            : bh.kind == BLOCK_DENSE && bh.payload_bytes == static_cast<std::size_t>(rows_) * cols_ * sizeof(int))
+                && offset + bh.payload_bytes <= end_;
+        }
+
+    private:
+        static std::size_t pad(std::size_t n) {
+            return (n + 63) & ~static_cast<std::size_t>(63);
+        }
+
+        void writeAt(const void *buf, std::size_t len, std::size_t at) {
+            const char *p = static_cast<const char *>(buf);
+            while (len) {
+                ssize_t n = pwrite(fd_, p, len, at);
+                if (n < 0) {
+                    if (errno == EINTR)
+                        continue;
+                    throw std::runtime_error("failed to write reuse store: " + std::string(std::strerror(errno)));
+                }
+                p += n;
+                at += n;
+                len -= n;
+            }
+        }
+
+        // gathers iov into the file at offset at, IOV_MAX buffers per call and resuming after short writes
+        void writeAt(std::vector<iovec> &iov, std::size_t at) {
+            std::size_t i = 0;
+            while (i < iov.size()) {
+                ssize_t n = pwritev(fd_, &iov[i], std::min<std::size_t>(iov.size() - i, IOV_MAX), at);
+                if (n < 0) {
+                    if (errno == EINTR)
+                        continue;
+                    throw std::runtime_error("failed to write reuse store: " + std::string(std::strerror(errno)));
+                }
+                at += n;
+                // skip the buffers written completely, then trim the one written in part
+                for (; i < iov.size() && static_cast<std::size_t>(n) >= iov[i].iov_len; i++)
+                    n -= iov[i].iov_len;
+                if (n) {
+                    iov[i].iov_base = static_cast<char *>(iov[i].iov_base) + n;
+                    iov[i].iov_len -= n;
+                }
+            }
+        }
+
+        int fd_;
+        int rows_;
+        int cols_;
+        std::size_t end_;
+        std::shared_ptr<const store_mapping> mapping_;
+        std::mutex m_;
+};
+
+// reusables/index.bin: journal of every block appended to any store, so a restarted CN gets its reuse table back
+// without opening thousands of store files
+//   file header (16 bytes): magic "MACI", format version, record size
+//   fixed-size records, one per block, in the order the blocks were appended
+// the last record of a (digest, exponent) wins; an exponent 1 record means the store was started over, so it drops
+// whatever came before it for that digest, and an exponent 0 record means the store was evicted
+// records dropped that way are dead weight until compact() rewrites the journal with only the live ones
+struct index_file_header {
+    char magic[4];
+    std::uint32_t version;
+    std::uint32_t record_bytes;
+    std::uint32_t reserved;
+};
+
+struct index_record {
+    matrix_digest digest;
+    std::int32_t exponent;
+    // shape of the matrix; only the subproducts of a matrix chain are not square
+    std::uint32_t rows;
+    std::uint32_t cols;
+    std::uint32_t reserved;
+    // payload offset of the block in reusables/<digest>.bin
+    std::uint64_t offset;
+};
+
+const std::uint32_t INDEX_VERSION = 1;
+// dead records a journal needs before it is worth compacting (a 56-byte record each)
+const std::size_t INDEX_COMPACT_MIN_DEAD = 4096;
+
+static_assert(sizeof(index_file_header) == 16, "index file header must stay 16 bytes");
+static_assert(sizeof(index_record) == 56, "index records must stay 56 bytes");
+
+class reuse_index {
+    public:
+        // opens the journal at path, creating it if needed; an unreadable journal is started over (the stores it
+        // pointed to are simply not reused), a torn last record from a crash is cut off
+        explicit reuse_index(const std::string &path) : path_(path) {
+            fd_ = open(path.c_str(), O_RDWR | O_CREAT, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+            if (fd_ < 0)
+                throw std::runtime_error("failed to open reuse index " + path + ": " + std::strerror(errno));
+            struct stat st;
+            fstat(fd_, &st);
+            end_ = st.st_size;
+            index_file_header h;
+            bool readable = end_ >= sizeof(h) && pread(fd_, &h, sizeof(h), 0) == sizeof(h) && !std::memcmp(h.magic, "MACI", 4);
+            if (!readable || h.version != INDEX_VERSION || h.record_bytes != sizeof(index_record)) {
+                if (end_)
+                    std::cerr << "reuse index " << path << " is unreadable, starting it over" << std::endl;
+                h = index_file_header{};
+                std::memcpy(h.magic, "MACI", 4);
+                h.version = INDEX_VERSION;
+                h.record_bytes = sizeof(index_record);
+                if (ftruncate(fd_, 0) < 0 || pwrite(fd_, &h, sizeof(h), 0) != sizeof(h))
+                    throw std::runtime_error("failed to write reuse index " + path + ": " + std::strerror(errno));
+                end_ = sizeof(h);
+            }
+            std::size_t whole = sizeof(h) + (end_ - sizeof(h)) / sizeof(index_record) * sizeof(index_record);
+            if (whole != end_) {
+                end_ = whole;
+                if (ftruncate(fd_, end_) < 0)
+                    throw std::runtime_error("failed to truncate reuse index " + path + ": " + std::strerror(errno));
+            }
+        }
+
+        ~reuse_index() {
+            close(fd_);
+        }
+
+        reuse_index(const reuse_index &) = delete;
+        reuse_index &operator=(const reuse_index &) = delete;
+
+        // maps the journal and hands every record to f in order; nothing is parsed or copied beyond the records
+        template <typename F>
+        void replay(F f) {
+            std::lock_guard<std::mutex> lock(m_);
+            if (end_ == sizeof(index_file_header))
+                return;
+            store_mapping map(fd_, end_);
+            const index_record *r = reinterpret_cast<const index_record *>(map.data() + sizeof(index_file_header));
+            std::size_t n = (end_ - sizeof(index_file_header)) / sizeof(index_record);
+            for (std::size_t i = 0; i < n; i++)
+                f(r[i]);
+        }
+
+        // records a block that was just appended to a store
+        void append(const matrix_digest &digest, int exponent, int rows, int cols, std::size_t offset) {
+            index_record r{};
+            r.digest = digest;
+            r.exponent = exponent;
+            r.rows = rows;
+            r.cols = cols;
+            r.offset = offset;
+            append(std::vector<index_record>{r});
+        }
+
+        // records several blocks in one write
+        void append(const std::vector<index_record> &records) {
+            std::size_t len = records.size() * sizeof(index_record);
+            std::lock_guard<std::mutex> lock(m_);
+            if (len && pwrite(fd_, records.data(), len, end_) != static_cast<ssize_t>(len))
+                throw std::runtime_error("failed to write reuse index " + path_ + ": " + std::strerror(errno));
+            end_ += len;
+        }
+
+        // flushes every record appended so far to the disk
+        void sync() {
+            if (fdatasync(fd_) < 0)
+                throw std::runtime_error("failed to sync reuse index " + path_ + ": " + std::strerror(errno));
+        }
+
+        // rewrites the journal with only its live records (the ones replay would still act on), in their order, once at
+        // least min_dead records are dead and they outnumber the live ones; appends wait for it, so a record written
+        // while the table changes is never lost; returns the number of records dropped, 0 if it left the journal alone
+        std::size_t compact(std::size_t min_dead) {
+            std::lock_guard<std::mutex> lock(m_);
+            std::size_t n = (end_ - sizeof(index_file_header)) / sizeof(index_record);
+            if (n < min_dead)
+                return 0;
+            std::vector<index_record> live;
+            {
+                store_mapping map(fd_, end_);
+                const index_record *r = reinterpret_cast<const index_record *>(map.data() + sizeof(index_file_header));
+                // digest -> exponent -> its last record
+                std::unordered_map<matrix_digest, std::map<int, std::size_t>, digest_hash> last;
+                for (std::size_t i = 0; i < n; i++) {
+                    auto it = last.find(r[i].digest);
+                    if (r[i].exponent == 0) {
+                        if (it != last.end())
+                            last.erase(it);
+                        continue;
+                    }
+                    if (it == last.end())
+                        it = last.emplace(r[i].digest, std::map<int, std::size_t>()).first;
+                    else if (r[i].exponent == 1 || r[it->second.begin()->second].rows != r[i].rows || r[it->second.begin()->second].cols != r[i].cols)
+                        // started over, or a different shape (which replay starts over too)
+                        it->second.clear();
+                    it->second[r[i].exponent] = i;
+                }
+                std::vector<std::size_t> keep;
+                for (const auto &d : last)
+                    for (const auto &e : d.second)
+                        keep.push_back(e.second);
+                if (n - keep.size() < min_dead || n - keep.size() < keep.size())
+                    return 0;
+                std::sort(keep.begin(), keep.end());
+                live.reserve(keep.size());
+                for (std::size_t i : keep)
+                    live.push_back(r[i]);
+            }
+            swapIn(live);
+            return n - live.size();
+        }
+
+    private:
+        // writes a journal holding records next to this one and renames it over it, so a crash midway leaves the old one
+        // intact; the caller holds m_
+        void swapIn(const std::vector<index_record> &records) {
+            index_file_header h{};
+            std::memcpy(h.magic, "MACI", 4);
+            h.version = INDEX_VERSION;
+            h.record_bytes = sizeof(index_record);
+            std::string tmp(path_ + ".tmp");
+            int fd = open(tmp.c_str(), O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+            ssize_t len = records.size() * sizeof(index_record);
+            if (fd < 0 || pwrite(fd, &h, sizeof(h), 0) != sizeof(h) || (len && pwrite(fd, records.data(), len, sizeof(h)) != len)
+                || fdatasync(fd) < 0 || rename(tmp.c_str(), path_.c_str()) < 0) {
+                std::string err(std::strerror(errno));
+                if (fd >= 0)
+                    close(fd);
+                throw std::runtime_error("failed to rewrite reuse index " + path_ + ": " + err);
+            }
+            close(fd_);
+            fd_ = fd;
+            end_ = sizeof(h) + len;
+        }
+
+        std::string path_;
+        int fd_;
+        std::size_t end_;
+        std::mutex m_;
+};
+
+} // namespace examples
+} // namespace ndn
+
+#endif // REUSE_EDGE_REUSE_STORE_HPP
@@ -0,0 +1,173 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2013-2018 Regents of the University of California.
+ *
+ * This file is part of ndn-cxx library (NDN C++ library with eXperimental eXtensions).
+ *
+ * ndn-cxx library is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later version.
+ *
+ * ndn-cxx library is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more details.
+ *
+ * You should have received copies of the GNU General Public License and GNU Lesser
+ * General Public License along with ndn-cxx, e.g., in COPYING.md file.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * See AUTHORS.md for complete list of ndn-cxx authors and contributors.
+ */
+
+
+#ifndef REUSE_EDGE_REUSE_TIERS_HPP
+#define REUSE_EDGE_REUSE_TIERS_HPP
+
+#include <ndn-cxx/util/time.hpp>
+#include <../eigen/Eigen/Dense>
+
+#include <cstddef>
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+#include "reuse_store.hpp"
+
+namespace ndn {
+namespace examples {
+
+// byte budgets of the two tiers the cached powers live in
+struct tier_options {
+    // hot powers kept decoded in memory, 0 disables the RAM tier
+    std::size_t ram_bytes;
+    // stores under reusables/, 0 for no limit
+    std::size_t disk_bytes;
+    // how often hit ratios and tier sizes are logged
+    time::seconds report_interval;
+
+    tier_options()
+        : ram_bytes(std::size_t(256) << 20), disk_bytes(std::size_t(4096) << 20), report_interval(60) {}
+};
+
+// how much keeping a cached power is worth: the compute it saves (a dim^3 multiplication for every step of the exponent
+// distance to the next smaller power we would fall back to), discounted by how long it has gone unused, per byte it takes
+// the lowest score is evicted first
+inline double keepScore(double saved, double idle_s, std::size_t bytes) {
+    // a power left alone for five minutes is worth half as much as one used just now, ten minutes a third, ...
+    return saved / (1.0 + idle_s / 300.0) / std::max<std::size_t>(bytes, 1);
+}
+
+inline double savedCompute(int dim, int exponent, int below) {
+    double d = dim;
+    return d * d * d * (exponent - below);
+}
+
+// hit and size counters of the reuse tiers, reported every tier_options::report_interval
+struct tier_stats {
+    // tasks that looked their matrix up in the reuse table, and how many found it
+    std::atomic<std::size_t> lookups{0};
+    std::atomic<std::size_t> hits{0};
+    // cached powers (base matrices included) served from memory and from the stores
+    std::atomic<std::size_t> ram_loads{0};
+    std::atomic<std::size_t> disk_loads{0};
+    // bytes the stores take on disk, and what eviction removed from either tier
+    std::atomic<std::size_t> disk_bytes{0};
+    std::atomic<std::size_t> ram_evicted{0};
+    std::atomic<std::size_t> disk_evicted{0};
+};
+
+// RAM tier: decoded copies of the hottest cached powers, so they are served without touching the page cache or the disk
+// a power is admitted only if the powers it would push out are worth less (see keepScore)
+class ram_tier {
+    public:
+        explicit ram_tier(std::size_t budget) : budget_(budget), bytes_(0) {}
+
+        // the power if it is in memory; counts as a use
+        std::shared_ptr<const Eigen::MatrixXi> get(const matrix_digest &digest, int exponent) {
+            std::lock_guard<std::mutex> lock(m_);
+            auto it = items_.find(std::make_pair(digest, exponent));
+            if (it == items_.end())
+                return nullptr;
+            it->second.used = time::steady_clock::now();
+            return it->second.mat;
+        }
+
+        // offers a power that was just loaded from disk; saved is what it spares (see savedCompute)
+        // returns the number of powers evicted to make room, or -1 if it was not admitted
+        int offer(const matrix_digest &digest, int exponent, const Eigen::Ref<const Eigen::MatrixXi> &m, double saved) {
+            std::size_t bytes = static_cast<std::size_t>(m.size()) * sizeof(int);
+            if (bytes > budget_)
+                return -1;
+            time::steady_clock::time_point now = time::steady_clock::now();
+            double score = keepScore(saved, 0, bytes);
+            std::lock_guard<std::mutex> lock(m_);
+            if (items_.count(std::make_pair(digest, exponent)))
+                return -1;
+            // pick victims, lowest score first, until the newcomer fits; give up if any of them is worth more than it
+            std::multimap<double, key> victims;
+            if (bytes_ + bytes > budget_)
+                for (const auto &i : items_)
+                    victims.emplace(keepScore(i.second.saved, idleSeconds(i.second, now), i.second.bytes), i.first);
+            std::size_t freed = 0;
+            int evicted = 0;
+            for (auto v = victims.begin(); bytes_ - freed + bytes > budget_; ++v) {
+                if (v->first >= score)
+                    return -1;
+                freed += items_[v->second].bytes;
+                evicted++;
+            }
+            auto v = victims.begin();
+            for (int i = 0; i < evicted; i++, ++v) {
+                bytes_ -= items_[v->second].bytes;
+                items_.erase(v->second);
+            }
+            items_.emplace(std::make_pair(digest, exponent), item{std::make_shared<const Eigen::MatrixXi>(m), saved, now, bytes});
+            bytes_ += bytes;
+            return evicted;
+        }
+
+        // forgets every power of a matrix (its store was evicted)
+        void drop(const matrix_digest &digest) {
+            std::lock_guard<std::mutex> lock(m_);
+            for (auto it = items_.lower_bound(std::make_pair(digest, 0)); it != items_.end() && it->first.first == digest;) {
+                bytes_ -= it->second.bytes;
+                it = items_.erase(it);
+            }
+        }
+
+        std::size_t bytes() const {
+            std::lock_guard<std::mutex> lock(m_);
+            return bytes_;
+        }
+
+        std::size_t budget() const {
+            return budget_;
+        }
+
+    private:
+        typedef std::pair<matrix_digest, int> key;
+
+        struct item {
+            std::shared_ptr<const Eigen::MatrixXi> mat;
+            double saved;
+            time::steady_clock::time_point used;
+            std::size_t bytes;
+        };
+
+        static double idleSeconds(const item &i, time::steady_clock::time_point now) {
+            return time::duration_cast<time::milliseconds>(now - i.used).count() / 1000.0;
+        }
+
+        std::size_t budget_;
+        mutable std::mutex m_;
+        std::map<key, item> items_;
+        std::size_t bytes_;
+};
+
+} // namespace examples
+} // namespace ndn
+
+#endif // REUSE_EDGE_REUSE_TIERS_HPP
@@ -0,0 +1,91 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2013-2018 Regents of the University of California.
+ *
+ * This file is part of ndn-cxx library (NDN C++ library with eXperimental eXtensions).
+ *
+ * ndn-cxx library is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later version.
+ *
+ * ndn-cxx library is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more details.
+ *
+ * You should have received copies of the GNU General Public License and GNU Lesser
+ * General Public License along with ndn-cxx, e.g., in COPYING.md file.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * See AUTHORS.md for complete list of ndn-cxx authors and contributors.
+ */
+
+
+#ifndef REUSE_EDGE_ROLLING_UPSCALE_HPP
+#define REUSE_EDGE_ROLLING_UPSCALE_HPP
+
+#include <dlib/image_processing/frontal_face_detector.h>
+
+#include <algorithm>
+#include <cstring>
+
+namespace ndn {
+namespace examples {
+
+// whether every row of snapshot starts with the row of prev from column shift on, i.e. snapshot is prev with the camera
+// moved shift pixels to the right (and whatever that exposed on the right)
+inline bool movedFrom(const dlib::array2d<unsigned char> &snapshot, const dlib::array2d<unsigned char> &prev, long shift) {
+    long overlap = prev.nc() - shift;
+    if (shift <= 0 || overlap <= 0 || overlap > snapshot.nc() || snapshot.nr() != prev.nr())
+        return false;
+    for (long r = 0; r < snapshot.nr(); r++)
+        if (std::memcmp(&snapshot[r][0], &prev[r][shift], overlap))
+            return false;
+    return true;
+}
+
+// upscales snapshot by 2^times, exactly like calling dlib::pyramid_up(snapshot) times, but takes the columns it shares with
+// the previous snapshot from prev (that snapshot upscaled, shift upscaled pixels to the left of this one)
+// that only holds if the raw snapshots really are shifted copies of each other, which the caller checks with movedFrom
+// pyramid_up only looks at the pixels right around each output pixel and shifts by whole pixels commute with it, so away
+// from the edges of either frame the upscaled overlap is the previous frame's, moved over; only a thin strip at the left
+// edge and the newly exposed columns (plus a margin to the right of where prev's edge starts to show) are upscaled
+// returns the number of columns of snapshot that went through pyramid_up
+inline long upscaleSnapshot(const dlib::array2d<unsigned char> &snapshot, int times, const dlib::array2d<unsigned char> *prev, long shift,
+                            dlib::array2d<unsigned char> &out) {
+    const long scale = 1L << times;
+    // raw columns next to an edge whose upscaled pixels see past it, with plenty to spare
+    const long margin = 8;
+    auto upscale = [&](long beg, long end, dlib::array2d<unsigned char> &up){
+        dlib::pyramid_up(dlib::sub_image(snapshot, dlib::rectangle(beg, 0, end - 1, snapshot.nr() - 1)), up);
+        for (int i = 1; i < times; i++)
+            dlib::pyramid_up(up);
+    };
+    // upscaled columns [scale * margin, keep) come from prev, the new strip starts at raw column beg
+    long keep = prev ? prev->nc() - shift - scale * margin : 0;
+    long beg = keep / scale - margin;
+    dlib::array2d<unsigned char> left, right;
+    if (prev && times > 0 && shift > 0 && shift % scale == 0 && keep > 2 * scale * margin && beg + 2 * margin < snapshot.nc()) {
+        upscale(0, 2 * margin, left);
+        upscale(beg, snapshot.nc(), right);
+        if (left.nr() == prev->nr() && right.nr() == prev->nr()) {
+            out.set_size(right.nr(), beg * scale + right.nc());
+            for (long r = 0; r < out.nr(); r++) {
+                std::copy(&left[r][0], &left[r][0] + scale * margin, &out[r][0]);
+                std::copy(&(*prev)[r][0] + scale * margin + shift, &(*prev)[r][0] + keep + shift, &out[r][scale * margin]);
+                std::copy(&right[r][0] + keep - beg * scale, &right[r][0] + right.nc(), &out[r][keep]);
+            }
+            return 2 * margin + snapshot.nc() - beg;
+        }
+    }
+    // nothing to reuse (first snapshot, a different height)
+    if (times > 0)
+        upscale(0, snapshot.nc(), out);
+    else
+        dlib::assign_image(out, snapshot);
+    return snapshot.nc();
+}
+
+} // namespace examples
+} // namespace ndn
+
+#endif // REUSE_EDGE_ROLLING_UPSCALE_HPP
@@ -0,0 +1,246 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2013-2018 Regents of the University of California.
+ *
+ * This file is part of ndn-cxx library (NDN C++ library with eXperimental eXtensions).
+ *
+ * ndn-cxx library is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later version.
+ *
+ * ndn-cxx library is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more details.
+ *
+ * You should have received copies of the GNU General Public License and GNU Lesser
+ * General Public License along with ndn-cxx, e.g., in COPYING.md file.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * See AUTHORS.md for complete list of ndn-cxx authors and contributors.
+ */
+
+#ifndef REUSE_EDGE_SEGMENT_FETCHER_HPP
+#define REUSE_EDGE_SEGMENT_FETCHER_HPP
+
+#include <ndn-cxx/face.hpp>
+#include <ndn-cxx/util/scheduler.hpp>
+
+#include <cstddef>
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <vector>
+
+namespace ndn {
+namespace examples {
+
+// tuning knobs for fetching a requester's input
+struct fetch_options {
+    // minimum gap between two Interests to the same requester; Pi-class consumers drop Interests that come closer than
+    // 30 ms, so that is the default (0 disables pacing for consumers that keep up)
+    time::milliseconds pacing;
+    // congestion window the fetch starts with, in Interests
+    double initial_cwnd;
+    // congestion window never grows past this
+    double max_cwnd;
+    // retransmission timeout before the first RTT sample, and its bounds
+    time::milliseconds initial_rto;
+    time::milliseconds min_rto;
+    time::milliseconds max_rto;
+
+    fetch_options()
+        : pacing(30), initial_cwnd(2), max_cwnd(64), initial_rto(1000), min_rto(100), max_rto(8000) {}
+};
+
+// fetches segments 0 .. n-1 of a requester's input with a congestion window instead of fixed pacing
+// additive increase (slow start up to ssthresh, then +1 per window), multiplicative decrease on a timeout or Nack,
+// retransmission timeout from smoothed RTT samples (RFC 6298, Karn's rule for retransmitted segments) with exponential backoff
+// everything runs on the face's io_service thread
+class segment_fetcher : public std::enable_shared_from_this<segment_fetcher> {
+    public:
+        // name of segment i, without the version component
+        typedef std::function<Name(int)> NameFunc;
+        // segment i arrived
+        typedef std::function<void(int, const Data &)> SegmentFunc;
+        // every segment arrived
+        typedef std::function<void()> DoneFunc;
+
+        static shared_ptr<segment_fetcher> start(Face &face, Scheduler &scheduler, std::mutex &face_m, int segments, const fetch_options &opts,
+                                                 const NameFunc &name, const SegmentFunc &onSegment, const DoneFunc &onDone) {
+            shared_ptr<segment_fetcher> f(new segment_fetcher(face, scheduler, face_m, segments, opts, name, onSegment, onDone));
+            f->sendMore();
+            return f;
+        }
+
+        // abandons the fetch; late Data and timeouts are ignored from now on
+        void stop() {
+            stopped_ = true;
+        }
+
+        int received() const {
+            return received_;
+        }
+
+    private:
+        typedef time::steady_clock clock;
+
+        struct in_flight {
+            clock::time_point sent;
+            // bumped on every (re)transmission so callbacks of superseded Interests are ignored
+            int token;
+            bool retransmitted;
+        };
+
+        segment_fetcher(Face &face, Scheduler &scheduler, std::mutex &face_m, int segments, const fetch_options &opts,
+                        const NameFunc &name, const SegmentFunc &onSegment, const DoneFunc &onDone)
+            : face_(face), scheduler_(scheduler), face_m_(face_m), opts_(opts), name_(name), onSegment_(onSegment), onDone_(onDone),
+              done_(segments, false), next_(0), received_(0), cwnd_(opts.initial_cwnd), ssthresh_(opts.max_cwnd),
+              srtt_(0), rttvar_(0), rto_(opts.initial_rto), last_send_(clock::time_point::min()), last_decrease_(clock::now()),
+              wakeup_scheduled_(false), stopped_(false), tokens_(0) {}
+
+        void sendMore() {
+            if (stopped_)
+                return;
+            while (inflight_.size() < static_cast<std::size_t>(cwnd_) && (!retx_.empty() || next_ < static_cast<int>(done_.size()))) {
+                // respect the pacing floor, coming back once it has passed
+                clock::time_point now = clock::now();
+                if (opts_.pacing.count() > 0 && last_send_ != clock::time_point::min() && now < last_send_ + opts_.pacing) {
+                    if (!wakeup_scheduled_) {
+                        wakeup_scheduled_ = true;
+                        auto self = shared_from_this();
+                        scheduler_.scheduleEvent(time::duration_cast<time::nanoseconds>(last_send_ + opts_.pacing - now), [self]{
+                            self->wakeup_scheduled_ = false;
+                            self->sendMore();
+                        });
+                    }
+                    return;
+                }
+                int seg;
+                bool retx = !retx_.empty();
+                if (retx) {
+                    seg = retx_.front();
+                    retx_.pop_front();
+                    if (done_[seg])
+                        continue;
+                } else
+                    seg = next_++;
+                send(seg, retx);
+            }
+        }
+
+        void send(int seg, bool retx) {
+            in_flight &f = inflight_[seg];
+            f.sent = last_send_ = clock::now();
+            f.token = ++tokens_;
+            f.retransmitted = retx;
+            // append a fresh Version so a retransmission is not taken for a duplicate Interest
+            Interest interest(Name(name_(seg)).appendVersion());
+            interest.setInterestLifetime(rto_);
+            interest.setMustBeFresh(true);
+            auto self = shared_from_this();
+            int token = f.token;
+            std::lock_guard<std::mutex> lock(face_m_);
+            face_.expressInterest(interest,
+                                  [self, seg, token](const Interest &, const Data &data){
+                                      self->onData(seg, token, data);
+                                  },
+                                  [self, seg, token](const Interest &i, const lp::Nack &nack){
+                                      std::cerr << "received Nack with reason " << nack.getReason() << " for interest " << i << std::endl;
+                                      self->onLoss(seg, token);
+                                  },
+                                  [self, seg, token](const Interest &i){
+                                      std::cerr << "Timeout " << i << std::endl;
+                                      self->onLoss(seg, token);
+                                  });
+        }
+
+        void onData(int seg, int token, const Data &data) {
+            if (stopped_ || done_[seg])
+                return;
+            auto it = inflight_.find(seg);
+            if (it != inflight_.end()) {
+                // Karn's rule: only segments sent once give an unambiguous RTT sample
+                if (!it->second.retransmitted && it->second.token == token)
+                    sampleRtt(clock::now() - it->second.sent);
+                inflight_.erase(it);
+            }
+            done_[seg] = true;
+            received_++;
+            // slow start below ssthresh, congestion avoidance above
+            if (cwnd_ < ssthresh_)
+                cwnd_ += 1;
+            else
+                cwnd_ += 1 / cwnd_;
+            cwnd_ = std::min(cwnd_, opts_.max_cwnd);
+            onSegment_(seg, data);
+            if (received_ == static_cast<int>(done_.size())) {
+                stopped_ = true;
+                onDone_();
+            } else
+                sendMore();
+        }
+
+        void onLoss(int seg, int token) {
+            if (stopped_ || done_[seg])
+                return;
+            auto it = inflight_.find(seg);
+            // a newer transmission of this segment is already out
+            if (it == inflight_.end() || it->second.token != token)
+                return;
+            // halve the window at most once per round trip, however many segments of it were lost
+            if (it->second.sent >= last_decrease_) {
+                ssthresh_ = std::max(cwnd_ / 2, 2.0);
+                cwnd_ = ssthresh_;
+                last_decrease_ = clock::now();
+            }
+            // back off the timer until a fresh sample comes in
+            rto_ = std::min(rto_ * 2, opts_.max_rto);
+            inflight_.erase(it);
+            retx_.push_back(seg);
+            sendMore();
+        }
+
+        void sampleRtt(clock::duration sample) {
+            double r = time::duration_cast<time::microseconds>(sample).count() / 1000.0;
+            if (srtt_ == 0) {
+                srtt_ = r;
+                rttvar_ = r / 2;
+            } else {
+                rttvar_ = 0.75 * rttvar_ + 0.25 * std::abs(srtt_ - r);
+                srtt_ = 0.875 * srtt_ + 0.125 * r;
+            }
+            rto_ = std::max(opts_.min_rto, std::min(opts_.max_rto, time::milliseconds(static_cast<long>(std::ceil(srtt_ + 4 * rttvar_)))));
+        }
+
+        Face &face_;
+        Scheduler &scheduler_;
+        std::mutex &face_m_;
+        fetch_options opts_;
+        NameFunc name_;
+        SegmentFunc onSegment_;
+        DoneFunc onDone_;
+        std::vector<bool> done_;
+        std::map<int, in_flight> inflight_;
+        std::deque<int> retx_;
+        int next_;
+        int received_;
+        double cwnd_;
+        double ssthresh_;
+        double srtt_;
+        double rttvar_;
+        time::milliseconds rto_;
+        clock::time_point last_send_;
+        clock::time_point last_decrease_;
+        bool wakeup_scheduled_;
+        bool stopped_;
+        int tokens_;
+};
+
+} // namespace examples
+} // namespace ndn
+
+#endif // REUSE_EDGE_SEGMENT_FETCHER_HPP
@@ -0,0 +1,142 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2013-2018 Regents of the University of California.
+ *
+ * This file is part of ndn-cxx library (NDN C++ library with eXperimental eXtensions).
+ *
+ * ndn-cxx library is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later version.
+ *
+ * ndn-cxx library is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more details.
+ *
+ * You should have received copies of the GNU General Public License and GNU Lesser
+ * General Public License along with ndn-cxx, e.g., in COPYING.md file.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * See AUTHORS.md for complete list of ndn-cxx authors and contributors.
+ */
+
+
+#ifndef REUSE_EDGE_SHARDED_MAP_HPP
+#define REUSE_EDGE_SHARDED_MAP_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <array>
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <unordered_map>
+#include <utility>
+
+namespace ndn {
+namespace examples {
+
+// concurrent hash map for the reuse tables, split into independently locked shards
+// a lookup only takes its shard's lock in shared mode and an insert only blocks its own shard, so requests for different
+// keys never wait on each other; values are handed out by copy (shared_ptrs to per-key entries in practice), so nothing
+// slow ever runs while a shard is locked: whatever a caller does with an entry happens under that entry's own lock
+template <typename Key, typename Value, typename Hash = std::hash<Key>, std::size_t Shards = 64>
+class sharded_map {
+    public:
+        sharded_map() : size_(0) {}
+
+        // copy of the value under k, if any
+        std::optional<Value> find(const Key &k) const {
+            const shard &s = shardOf(k);
+            std::shared_lock<std::shared_timed_mutex> slock(s.m);
+            auto it = s.map.find(k);
+            if (it == s.map.end())
+                return std::nullopt;
+            return it->second;
+        }
+
+        bool contains(const Key &k) const {
+            const shard &s = shardOf(k);
+            std::shared_lock<std::shared_timed_mutex> slock(s.m);
+            return s.map.count(k) != 0;
+        }
+
+        // inserts v under k unless k is there already
+        // returns the value now under k and whether it was the one inserted
+        std::pair<Value, bool> insert(const Key &k, Value v) {
+            shard &s = shardOf(k);
+            std::lock_guard<std::shared_timed_mutex> ulock(s.m);
+            auto res = s.map.emplace(k, std::move(v));
+            if (res.second)
+                size_++;
+            return {res.first->second, res.second};
+        }
+
+        // puts v under k, replacing whatever was there
+        void assign(const Key &k, Value v) {
+            shard &s = shardOf(k);
+            std::lock_guard<std::shared_timed_mutex> ulock(s.m);
+            auto res = s.map.insert_or_assign(k, std::move(v));
+            if (res.second)
+                size_++;
+        }
+
+        // removes k only if it still maps to v, so a value somebody replaced meanwhile survives
+        bool erase(const Key &k, const Value &v) {
+            shard &s = shardOf(k);
+            std::lock_guard<std::shared_timed_mutex> ulock(s.m);
+            auto it = s.map.find(k);
+            if (it == s.map.end() || !(it->second == v))
+                return false;
+            s.map.erase(it);
+            size_--;
+            return true;
+        }
+
+        // number of keys; exact when nothing is inserting concurrently, a close estimate otherwise
+        std::size_t size() const {
+            return size_.load(std::memory_order_relaxed);
+        }
+
+        // calls f(key, value) for every element, one shard at a time under its shared lock (f must not touch the map)
+        template <typename F>
+        void forEach(F f) const {
+            for (const shard &s : shards_) {
+                std::shared_lock<std::shared_timed_mutex> slock(s.m);
+                for (const auto &kv : s.map)
+                    f(kv.first, kv.second);
+            }
+        }
+
+    private:
+        // a cache line apart so shards locked by different threads don't share one
+        struct alignas(64) shard {
+            mutable std::shared_timed_mutex m;
+            std::unordered_map<Key, Value, Hash> map;
+        };
+
+        // the bucket hash decides the shard too, mixed first so keys whose hash differs only in its high bits still spread
+        shard &shardOf(const Key &k) {
+            return shards_[mix(Hash()(k)) % Shards];
+        }
+
+        const shard &shardOf(const Key &k) const {
+            return shards_[mix(Hash()(k)) % Shards];
+        }
+
+        static std::size_t mix(std::uint64_t h) {
+            h ^= h >> 33;
+            h *= 0xff51afd7ed558ccdULL;
+            h ^= h >> 33;
+            return static_cast<std::size_t>(h);
+        }
+
+        std::array<shard, Shards> shards_;
+        std::atomic<std::size_t> size_;
+};
+
+} // namespace examples
+} // namespace ndn
+
+#endif // REUSE_EDGE_SHARDED_MAP_HPP
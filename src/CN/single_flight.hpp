@@ -0,0 +1,84 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2013-2018 Regents of the University of California.
+ *
+ * This file is part of ndn-cxx library (NDN C++ library with eXperimental eXtensions).
+ *
+ * ndn-cxx library is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later version.
+ *
+ * ndn-cxx library is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more details.
+ *
+ * You should have received copies of the GNU General Public License and GNU Lesser
+ * General Public License along with ndn-cxx, e.g., in COPYING.md file.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * See AUTHORS.md for complete list of ndn-cxx authors and contributors.
+ */
+
+
+#ifndef REUSE_EDGE_SINGLE_FLIGHT_HPP
+#define REUSE_EDGE_SINGLE_FLIGHT_HPP
+
+#include <functional>
+#include <map>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace ndn {
+namespace examples {
+
+// coalesces concurrent requests for the same input (a matrix digest, a FEN) into one flight
+// the first request leads and does the work; the ones arriving while it is in the air attach a continuation instead of
+// parking a thread, and all of them are completed at once with the leader's outcome when it finishes
+template <typename Key, typename Value, typename Compare = std::less<Key> >
+class single_flight {
+    public:
+        // run with the leader's outcome when the flight lands
+        typedef std::function<void(const Value &)> Continuation;
+
+        // starts a flight for k unless one is in the air; true if the caller leads it (and has to finish it)
+        bool lead(const Key &k) {
+            std::lock_guard<std::mutex> lock(m_);
+            return flights_.emplace(k, std::vector<Continuation>()).second;
+        }
+
+        // attaches cont to the flight for k; false if there is none (it landed meanwhile), so the caller carries on alone
+        bool follow(const Key &k, Continuation cont) {
+            std::lock_guard<std::mutex> lock(m_);
+            auto it = flights_.find(k);
+            if (it == flights_.end())
+                return false;
+            it->second.push_back(std::move(cont));
+            return true;
+        }
+
+        // lands the flight for k and completes everyone who followed it with v, on the calling thread and outside the lock
+        void finish(const Key &k, const Value &v) {
+            std::vector<Continuation> followers;
+            {
+                std::lock_guard<std::mutex> lock(m_);
+                auto it = flights_.find(k);
+                if (it == flights_.end())
+                    return;
+                followers.swap(it->second);
+                flights_.erase(it);
+            }
+            for (const Continuation &c : followers)
+                c(v);
+        }
+
+    private:
+        std::mutex m_;
+        // key -> continuations of the requests following its flight
+        std::map<Key, std::vector<Continuation>, Compare> flights_;
+};
+
+} // namespace examples
+} // namespace ndn
+
+#endif // REUSE_EDGE_SINGLE_FLIGHT_HPP
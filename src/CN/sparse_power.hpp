@@ -0,0 +1,195 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2013-2018 Regents of the University of California.
+ *
+ * This file is part of ndn-cxx library (NDN C++ library with eXperimental eXtensions).
+ *
+ * ndn-cxx library is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later version.
+ *
+ * ndn-cxx library is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more details.
+ *
+ * You should have received copies of the GNU General Public License and GNU Lesser
+ * General Public License along with ndn-cxx, e.g., in COPYING.md file.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * See AUTHORS.md for complete list of ndn-cxx authors and contributors.
+ */
+
+
+#ifndef REUSE_EDGE_SPARSE_POWER_HPP
+#define REUSE_EDGE_SPARSE_POWER_HPP
+
+#include <../eigen/Eigen/Dense>
+#include <../eigen/Eigen/Sparse>
+
+#include <cstddef>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include "int_gemm.hpp"
+#include "reuse_store.hpp"
+
+namespace ndn {
+namespace examples {
+
+// when powers of a matrix are computed and cached sparse
+// sparse products cost roughly nnz(A) * nnz(B) / dim instead of dim^3, which wins by a wide margin for adjacency and
+// transition matrices; powers fill in as the exponent grows, so a power past max_fill is switched to dense for good
+struct sparse_options {
+    // a base matrix at most this dense (nonzeros / elements) takes the sparse path, 0 disables it
+    double density;
+    // a sparse product denser than this is converted to dense, and everything computed from it stays dense
+    double max_fill;
+
+    sparse_options() : density(0.05), max_fill(0.15) {}
+};
+
+inline double fillOf(std::size_t nnz, Eigen::Index rows, Eigen::Index cols) {
+    return rows && cols ? static_cast<double>(nnz) / (static_cast<double>(rows) * cols) : 0;
+}
+
+inline std::size_t countNonZeros(const Eigen::Ref<const Eigen::MatrixXi> &m) {
+    return (m.array() != 0).count();
+}
+
+// a power of a matrix as the power chain carries it: sparse, dense, or dense and mapped straight out of a store
+class power_value {
+    public:
+        power_value() : kind_(EMPTY) {}
+
+        explicit power_value(Eigen::MatrixXi m) : kind_(DENSE), dense_(std::move(m)) {}
+
+        // m is compressed if it isn't already
+        explicit power_value(sparse_matrix m) : kind_(SPARSE), sparse_(std::move(m)) {
+            sparse_.makeCompressed();
+        }
+
+        explicit power_value(mapped_matrix m) : kind_(MAPPED), mapped_(std::make_shared<const mapped_matrix>(std::move(m))) {}
+
+        bool empty() const {
+            return kind_ == EMPTY;
+        }
+
+        bool sparse() const {
+            return kind_ == SPARSE;
+        }
+
+        Eigen::Index rows() const {
+            return kind_ == SPARSE ? sparse_.rows() : dense().rows();
+        }
+
+        Eigen::Index cols() const {
+            return kind_ == SPARSE ? sparse_.cols() : dense().cols();
+        }
+
+        // the elements of a dense (or mapped) power, without copying
+        Eigen::Ref<const Eigen::MatrixXi> dense() const {
+            if (kind_ == MAPPED)
+                return mapped_->mat;
+            if (kind_ != DENSE)
+                throw std::logic_error("not a dense power");
+            return dense_;
+        }
+
+        const sparse_matrix &compressed() const {
+            if (kind_ != SPARSE)
+                throw std::logic_error("not a sparse power");
+            return sparse_;
+        }
+
+        Eigen::MatrixXi toDense() const {
+            if (kind_ == SPARSE)
+                return Eigen::MatrixXi(sparse_);
+            return dense();
+        }
+
+        // a copy that owns its elements, so it outlives the store it may have been mapped from
+        power_value owned() const {
+            if (kind_ == MAPPED)
+                return power_value(Eigen::MatrixXi(mapped_->mat));
+            return *this;
+        }
+
+        // bytes the elements take in memory (and, roughly, in a store)
+        std::size_t bytes() const {
+            if (kind_ == SPARSE)
+                return (static_cast<std::size_t>(sparse_.cols()) + 1 + 2 * static_cast<std::size_t>(sparse_.nonZeros())) * sizeof(int);
+            if (kind_ == EMPTY)
+                return 0;
+            return static_cast<std::size_t>(rows()) * cols() * sizeof(int);
+        }
+
+        double fill() const {
+            if (kind_ == SPARSE)
+                return fillOf(sparse_.nonZeros(), sparse_.rows(), sparse_.cols());
+            return kind_ == EMPTY ? 0 : 1;
+        }
+
+        // the block to hand to matrix_store::append; only valid while this power is alive
+        store_block block(int exponent) const {
+            if (kind_ == SPARSE)
+                return store_block{exponent, nullptr, &sparse_};
+            if (kind_ != DENSE)
+                throw std::logic_error("only owned powers are appended to a store");
+            return store_block{exponent, &dense_, nullptr};
+        }
+
+        void swap(power_value &o) {
+            std::swap(kind_, o.kind_);
+            dense_.swap(o.dense_);
+            sparse_.swap(o.sparse_);
+            mapped_.swap(o.mapped_);
+        }
+
+    private:
+        friend void multiplyPowers(const int_gemm &, const power_value &, const power_value &, power_value &, double);
+
+        enum kind {EMPTY, DENSE, SPARSE, MAPPED};
+
+        kind kind_;
+        Eigen::MatrixXi dense_;
+        sparse_matrix sparse_;
+        // shared, since a mapping can't be reassigned
+        std::shared_ptr<const mapped_matrix> mapped_;
+};
+
+// c = a * b (c must not alias a or b)
+// sparse times sparse stays sparse unless the product fills in past max_fill; anything with a dense operand is dense,
+// and dense times dense goes to the gemm kernel
+inline void multiplyPowers(const int_gemm &gemm, const power_value &a, const power_value &b, power_value &c, double max_fill) {
+    if (a.sparse() && b.sparse()) {
+        sparse_matrix p = a.compressed() * b.compressed();
+        // products can cancel out to explicit zeros, which only waste space
+        p.prune([](const Eigen::Index &, const Eigen::Index &, const int &v){
+            return v != 0;
+        });
+        if (fillOf(p.nonZeros(), p.rows(), p.cols()) > max_fill)
+            c = power_value(Eigen::MatrixXi(p));
+        else
+            c = power_value(std::move(p));
+    } else if (a.sparse()) {
+        Eigen::MatrixXi p = a.compressed() * b.dense();
+        c = power_value(std::move(p));
+    } else if (b.sparse()) {
+        Eigen::MatrixXi p = a.dense() * b.compressed();
+        c = power_value(std::move(p));
+    } else {
+        // reuse c's elements if it is dense already, so a chain of dense products allocates nothing
+        Eigen::MatrixXi p;
+        if (c.kind_ == power_value::DENSE)
+            p.swap(c.dense_);
+        gemm.multiply(a.dense(), b.dense(), p);
+        c = power_value(std::move(p));
+    }
+}
+
+} // namespace examples
+} // namespace ndn
+
+#endif // REUSE_EDGE_SPARSE_POWER_HPP
@@ -0,0 +1,200 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2013-2018 Regents of the University of California.
+ *
+ * This file is part of ndn-cxx library (NDN C++ library with eXperimental eXtensions).
+ *
+ * ndn-cxx library is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later version.
+ *
+ * ndn-cxx library is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more details.
+ *
+ * You should have received copies of the GNU General Public License and GNU Lesser
+ * General Public License along with ndn-cxx, e.g., in COPYING.md file.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * See AUTHORS.md for complete list of ndn-cxx authors and contributors.
+ */
+
+
+#ifndef REUSE_EDGE_SPECULATION_HPP
+#define REUSE_EDGE_SPECULATION_HPP
+
+#include <ndn-cxx/util/time.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cmath>
+#include <map>
+#include <mutex>
+#include <set>
+#include <utility>
+#include <vector>
+
+#include "power_plan.hpp"
+#include "reuse_store.hpp"
+
+namespace ndn {
+namespace examples {
+
+// precomputing powers of popular matrices while the CN has nothing else to do, so the first requester of A^e finds
+// (most of) it cached instead of paying for the whole chain
+struct speculation_options {
+    // time between looks at the worker pool, 0 disables speculation
+    time::milliseconds interval;
+    // speculation may keep one core busy for at most this share of the time the CN has been running
+    double budget_share;
+    // multiplications a single speculative run may do
+    int max_multiplies;
+    // matrices whose demand is tracked, the least requested ones are forgotten first
+    std::size_t tracked;
+    // a request counts half as much after this long
+    time::seconds half_life;
+    // a matrix is popular once its decayed request count reaches this
+    double min_requests;
+
+    speculation_options()
+        : interval(1000), budget_share(0.2), max_multiplies(4), tracked(256), half_life(600), min_requests(2) {}
+};
+
+struct speculation_stats {
+    // speculative runs started, and how many of them gave the pool back early because requests came in
+    std::atomic<std::size_t> runs{0};
+    std::atomic<std::size_t> preempted{0};
+    std::atomic<std::size_t> multiplies{0};
+    // powers speculation handed to the store, and how many of them a request has used since
+    std::atomic<std::size_t> powers{0};
+    std::atomic<std::size_t> hits{0};
+    // runs skipped because speculation used up its share of the time
+    std::atomic<std::size_t> over_budget{0};
+    // time spent speculating, in microseconds
+    std::atomic<std::uint64_t> busy_us{0};
+};
+
+// what the requests for one matrix looked like lately
+struct matrix_demand {
+    matrix_digest digest;
+    // request count, decayed with the half-life
+    double count;
+    // highest exponent asked for
+    int max_exp;
+    // average step between the exponents of consecutive requests that went up, 0 while they never did
+    double trend;
+    int last_exp;
+    time::steady_clock::time_point last;
+};
+
+// request frequency and exponent trend of the most requested matrices, plus the powers speculation added for them
+// (so requests that use one can be counted as hits)
+class demand_tracker {
+    public:
+        explicit demand_tracker(const speculation_options &opts) : opts_(opts) {}
+
+        void record(const matrix_digest &digest, int exponent) {
+            time::steady_clock::time_point now = time::steady_clock::now();
+            std::lock_guard<std::mutex> lock(m_);
+            auto it = demand_.find(digest);
+            if (it == demand_.end()) {
+                if (demand_.size() >= opts_.tracked)
+                    forgetColdest(now);
+                demand_.emplace(digest, matrix_demand{digest, 1, exponent, 0, exponent, now});
+                return;
+            }
+            matrix_demand &d = it->second;
+            d.count = decayed(d, now) + 1;
+            if (exponent > d.last_exp)
+                d.trend = d.trend > 0 ? 0.7 * d.trend + 0.3 * (exponent - d.last_exp) : exponent - d.last_exp;
+            d.last_exp = exponent;
+            d.max_exp = std::max(d.max_exp, exponent);
+            d.last = now;
+        }
+
+        // the popular matrices, most requested first
+        std::vector<matrix_demand> popular() const {
+            time::steady_clock::time_point now = time::steady_clock::now();
+            std::vector<matrix_demand> out;
+            std::lock_guard<std::mutex> lock(m_);
+            for (const auto &d : demand_) {
+                double count = decayed(d.second, now);
+                if (count >= opts_.min_requests) {
+                    out.push_back(d.second);
+                    out.back().count = count;
+                }
+            }
+            std::sort(out.begin(), out.end(), [](const matrix_demand &a, const matrix_demand &b){
+                return a.count > b.count;
+            });
+            return out;
+        }
+
+        // notes that speculation cached power e of a matrix
+        void speculated(const matrix_digest &digest, int e) {
+            std::lock_guard<std::mutex> lock(m_);
+            speculated_.emplace(digest, e);
+        }
+
+        // counts (once) the speculated powers of a matrix a request for exponent e can use, given what is cached for it
+        std::size_t claim(const matrix_digest &digest, const std::map<int, std::size_t> &exps, int e) {
+            std::lock_guard<std::mutex> lock(m_);
+            std::size_t used = 0;
+            for (auto it = speculated_.lower_bound(std::make_pair(digest, 0)); it != speculated_.end() && it->first == digest;) {
+                if (it->second <= e && exps.count(it->second)) {
+                    it = speculated_.erase(it);
+                    used++;
+                } else
+                    ++it;
+            }
+            return used;
+        }
+
+    private:
+        double decayed(const matrix_demand &d, time::steady_clock::time_point now) const {
+            double age = time::duration_cast<time::milliseconds>(now - d.last).count() / 1000.0;
+            return d.count * std::exp2(-age / std::max<double>(opts_.half_life.count(), 1));
+        }
+
+        void forgetColdest(time::steady_clock::time_point now) {
+            auto coldest = std::min_element(demand_.begin(), demand_.end(), [&](const std::pair<const matrix_digest, matrix_demand> &a,
+                                                                               const std::pair<const matrix_digest, matrix_demand> &b){
+                return decayed(a.second, now) < decayed(b.second, now);
+            });
+            speculated_.erase(speculated_.lower_bound(std::make_pair(coldest->first, 0)), speculated_.lower_bound(std::make_pair(coldest->first, INT_MAX)));
+            demand_.erase(coldest);
+        }
+
+        speculation_options opts_;
+        mutable std::mutex m_;
+        std::map<matrix_digest, matrix_demand> demand_;
+        std::set<std::pair<matrix_digest, int> > speculated_;
+};
+
+// smallest exponent above e the checkpoint policy would cache, with e the closest smaller power cached; 0 if there is none
+inline int nextCheckpoint(const checkpoint_policy &policy, int e) {
+    for (int next = std::max(e + 1, 1); next < INT_MAX; next++)
+        if (policy.keep(next, e))
+            return next;
+    return 0;
+}
+
+// the power worth precomputing for a matrix, or 0 if there is none: the next checkpoint above the highest power cached,
+// as long as it doesn't go past the checkpoint above where its requests are heading (the highest exponent asked for
+// plus the trend)
+inline int speculationTarget(const checkpoint_policy &policy, const matrix_demand &demand, int max_cached) {
+    int next = nextCheckpoint(policy, max_cached);
+    long horizon = demand.max_exp + std::lround(demand.trend);
+    if (next <= 0 || horizon >= INT_MAX)
+        return 0;
+    int limit = nextCheckpoint(policy, static_cast<int>(horizon) - 1);
+    return limit > 0 && next <= limit ? next : 0;
+}
+
+} // namespace examples
+} // namespace ndn
+
+#endif // REUSE_EDGE_SPECULATION_HPP
@@ -0,0 +1,239 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2013-2018 Regents of the University of California.
+ *
+ * This file is part of ndn-cxx library (NDN C++ library with eXperimental eXtensions).
+ *
+ * ndn-cxx library is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later version.
+ *
+ * ndn-cxx library is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more details.
+ *
+ * You should have received copies of the GNU General Public License and GNU Lesser
+ * General Public License along with ndn-cxx, e.g., in COPYING.md file.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * See AUTHORS.md for complete list of ndn-cxx authors and contributors.
+ */
+
+
+#ifndef REUSE_EDGE_STORE_WRITER_HPP
+#define REUSE_EDGE_STORE_WRITER_HPP
+
+#include <ndn-cxx/util/time.hpp>
+#include <../eigen/Eigen/Dense>
+
+#include <cstddef>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "reuse_store.hpp"
+#include "sparse_power.hpp"
+
+namespace ndn {
+namespace examples {
+
+// tuning knobs for persisting cached powers
+struct persist_options {
+    // matrices waiting to be written may hold at most this many bytes; anything beyond is not cached
+    std::size_t queue_bytes;
+    // written blocks reach the disk (fdatasync) at least this often
+    time::milliseconds sync_interval;
+
+    persist_options()
+        : queue_bytes(std::size_t(512) << 20), sync_interval(1000) {}
+};
+
+// the one background stage that writes cached powers to their stores
+// tasks hand their powers over and carry on; the writer takes whatever has queued up since its last round and writes it
+// as one sequential append per store plus one append to the index, and syncs stores it wrote to every sync_interval
+// the queue is bounded in bytes: a power that doesn't fit (or is queued already) is simply not cached, so a task never
+// waits for the disk
+class store_writer {
+    public:
+        // called on the writer thread once the block is written, with the offset of its payload
+        typedef std::function<void(std::size_t)> PublishFunc;
+
+        // index (may be null) gets a record for every block written
+        store_writer(reuse_index *index, const persist_options &opts)
+            : index_(index), opts_(opts), bytes_(0), stop_(false), written_(0), skipped_(0), coalesced_(0),
+              thread_(&store_writer::run, this) {}
+
+        // writes out and syncs whatever is still queued
+        ~store_writer() {
+            {
+                std::lock_guard<std::mutex> lock(m_);
+                stop_ = true;
+            }
+            cv_.notify_one();
+            thread_.join();
+        }
+
+        store_writer(const store_writer &) = delete;
+        store_writer &operator=(const store_writer &) = delete;
+
+        // queues power exponent (m, dense or sparse; the writer keeps its own copy) of the matrix digest for store; false if
+        // it was dropped because the same power is queued already or the queue is full (publish is not called then)
+        bool submit(const std::shared_ptr<matrix_store> &store, const matrix_digest &digest, int exponent, const power_value &m, PublishFunc publish) {
+            std::size_t bytes = m.bytes();
+            {
+                std::lock_guard<std::mutex> lock(m_);
+                if (!queued_.emplace(store.get(), exponent).second) {
+                    coalesced_++;
+                    return false;
+                }
+                // a single power larger than the whole budget still goes through when nothing else is queued
+                if (bytes_ && bytes_ + bytes > opts_.queue_bytes) {
+                    queued_.erase(std::make_pair(store.get(), exponent));
+                    if (skipped_++ % 100 == 0)
+                        std::cout << "persist queue full (" << (bytes_ >> 20) << " MB), not caching power " << exponent << " of " << digestToHex(digest) << std::endl;
+                    return false;
+                }
+                bytes_ += bytes;
+                jobs_.push_back(job{store, digest, exponent, m.owned(), std::move(publish)});
+            }
+            cv_.notify_one();
+            return true;
+        }
+
+        // blocks written, powers skipped because the queue was full, powers dropped as duplicates
+        std::size_t written() const {
+            std::lock_guard<std::mutex> lock(m_);
+            return written_;
+        }
+
+        std::size_t skipped() const {
+            std::lock_guard<std::mutex> lock(m_);
+            return skipped_;
+        }
+
+        std::size_t coalesced() const {
+            std::lock_guard<std::mutex> lock(m_);
+            return coalesced_;
+        }
+
+    private:
+        struct job {
+            std::shared_ptr<matrix_store> store;
+            matrix_digest digest;
+            int exponent;
+            power_value mat;
+            PublishFunc publish;
+        };
+
+        void run() {
+            time::steady_clock::time_point last_sync = time::steady_clock::now();
+            // stores written to since the last sync
+            std::set<std::shared_ptr<matrix_store> > dirty;
+            std::unique_lock<std::mutex> lock(m_);
+            for (;;) {
+                cv_.wait_for(lock, opts_.sync_interval, [this]{
+                    return stop_ || !jobs_.empty();
+                });
+                std::deque<job> batch;
+                batch.swap(jobs_);
+                bool stopping = stop_;
+                lock.unlock();
+                if (!batch.empty())
+                    write(batch, dirty);
+                if (!dirty.empty() && (stopping || time::steady_clock::now() - last_sync >= opts_.sync_interval)) {
+                    sync(dirty);
+                    last_sync = time::steady_clock::now();
+                }
+                lock.lock();
+                // the batch is on disk (or failed), so its memory and its slots in the coalescing set are free again
+                for (const job &j : batch) {
+                    bytes_ -= j.mat.bytes();
+                    queued_.erase(std::make_pair(j.store.get(), j.exponent));
+                }
+                if (stopping && jobs_.empty())
+                    return;
+            }
+        }
+
+        // one append per store, one index append for the whole batch, then the new offsets are published
+        void write(std::deque<job> &batch, std::set<std::shared_ptr<matrix_store> > &dirty) {
+            std::map<matrix_store *, std::vector<job *> > by_store;
+            for (job &j : batch)
+                by_store[j.store.get()].push_back(&j);
+            std::vector<index_record> records;
+            std::vector<std::pair<job *, std::size_t> > done;
+            for (auto &s : by_store) {
+                std::vector<store_block> blocks;
+                for (job *j : s.second)
+                    blocks.push_back(j->mat.block(j->exponent));
+                try {
+                    std::vector<std::size_t> offsets = s.second.front()->store->append(blocks);
+                    for (std::size_t i = 0; i < offsets.size(); i++) {
+                        job *j = s.second[i];
+                        index_record r{};
+                        r.digest = j->digest;
+                        r.exponent = j->exponent;
+                        r.rows = j->mat.rows();
+                        r.cols = j->mat.cols();
+                        r.offset = offsets[i];
+                        records.push_back(r);
+                        done.emplace_back(j, offsets[i]);
+                    }
+                    dirty.insert(s.second.front()->store);
+                } catch (const std::exception &e) {
+                    std::cerr << "failed to persist " << blocks.size() << " powers: " << e.what() << std::endl;
+                }
+            }
+            try {
+                // journal them so a restarted CN still finds them
+                if (index_)
+                    index_->append(records);
+            } catch (const std::exception &e) {
+                std::cerr << "failed to journal " << records.size() << " powers: " << e.what() << std::endl;
+            }
+            for (auto &d : done)
+                d.first->publish(d.second);
+            std::lock_guard<std::mutex> lock(m_);
+            written_ += done.size();
+        }
+
+        void sync(std::set<std::shared_ptr<matrix_store> > &dirty) {
+            try {
+                for (const auto &s : dirty)
+                    s->sync();
+                if (index_)
+                    index_->sync();
+            } catch (const std::exception &e) {
+                std::cerr << e.what() << std::endl;
+            }
+            dirty.clear();
+        }
+
+        reuse_index *index_;
+        persist_options opts_;
+        mutable std::mutex m_;
+        std::condition_variable cv_;
+        std::deque<job> jobs_;
+        // (store, exponent) of every queued power, to drop duplicates
+        std::set<std::pair<const matrix_store *, int> > queued_;
+        std::size_t bytes_;
+        bool stop_;
+        std::size_t written_;
+        std::size_t skipped_;
+        std::size_t coalesced_;
+        // started last, once everything it uses is initialized
+        std::thread thread_;
+};
+
+} // namespace examples
+} // namespace ndn
+
+#endif // REUSE_EDGE_STORE_WRITER_HPP
@@ -0,0 +1,204 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2013-2018 Regents of the University of California.
+ *
+ * This file is part of ndn-cxx library (NDN C++ library with eXperimental eXtensions).
+ *
+ * ndn-cxx library is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later version.
+ *
+ * ndn-cxx library is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more details.
+ *
+ * You should have received copies of the GNU General Public License and GNU Lesser
+ * General Public License along with ndn-cxx, e.g., in COPYING.md file.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * See AUTHORS.md for complete list of ndn-cxx authors and contributors.
+ */
+
+
+#ifndef REUSE_EDGE_TILE_CACHE_HPP
+#define REUSE_EDGE_TILE_CACHE_HPP
+
+#include <ndn-cxx/util/sha256.hpp>
+#include <../eigen/Eigen/Dense>
+
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "int_gemm.hpp"
+#include "reuse_store.hpp"
+
+namespace ndn {
+namespace examples {
+
+// reuse below the whole-matrix level: a product is cut into tile x tile blocks, every tile of the operands is
+// digested, and the product of each pair of tiles (A_ik B_kj) is cached under the digests of the two
+// a matrix that is an update of an earlier one (a few rows or blocks changed) then only recomputes the tile products
+// that involve a changed tile; C_ij = sum over k of A_ik B_kj is summed from cached products wherever it can
+struct tile_options {
+    // tile edge in elements, 0 disables tiled reuse
+    int size;
+    // tile products kept in memory, least recently used dropped first
+    std::size_t bytes;
+
+    tile_options() : size(256), bytes(std::size_t(512) << 20) {}
+};
+
+// digest of the block of m at (row, col), same scheme as digestMatrix (shape, then the elements column by column)
+inline matrix_digest digestBlock(const Eigen::Ref<const Eigen::MatrixXi> &m, int row, int col, int rows, int cols) {
+    util::Sha256 sha;
+    std::uint32_t shape[2] = {static_cast<std::uint32_t>(rows), static_cast<std::uint32_t>(cols)};
+    sha.update(reinterpret_cast<const std::uint8_t *>(shape), sizeof(shape));
+    for (int c = col; c < col + cols; c++)
+        sha.update(reinterpret_cast<const std::uint8_t *>(&m.coeffRef(row, c)), rows * sizeof(int));
+    ConstBufferPtr buf = sha.computeDigest();
+    matrix_digest d;
+    std::copy(buf->begin(), buf->end(), d.begin());
+    return d;
+}
+
+// tile products by the digests of their two input tiles, bounded in bytes
+// a digest only covers the tile's shape and elements, so equal tiles at different positions (or in different
+// matrices) share their products
+class tile_cache {
+    public:
+        typedef std::pair<matrix_digest, matrix_digest> key;
+
+        explicit tile_cache(std::size_t budget) : budget_(budget), bytes_(0), hits_(0), misses_(0) {}
+
+        std::shared_ptr<const Eigen::MatrixXi> get(const key &k) {
+            std::lock_guard<std::mutex> lock(m_);
+            auto it = index_.find(k);
+            if (it == index_.end()) {
+                misses_++;
+                return nullptr;
+            }
+            hits_++;
+            // most recently used to the front
+            lru_.splice(lru_.begin(), lru_, it->second);
+            return it->second->second;
+        }
+
+        void put(const key &k, std::shared_ptr<const Eigen::MatrixXi> m) {
+            std::size_t bytes = static_cast<std::size_t>(m->size()) * sizeof(int);
+            if (bytes > budget_)
+                return;
+            std::lock_guard<std::mutex> lock(m_);
+            if (index_.count(k))
+                return;
+            while (bytes_ + bytes > budget_) {
+                bytes_ -= static_cast<std::size_t>(lru_.back().second->size()) * sizeof(int);
+                index_.erase(lru_.back().first);
+                lru_.pop_back();
+            }
+            lru_.emplace_front(k, std::move(m));
+            index_.emplace(k, lru_.begin());
+            bytes_ += bytes;
+        }
+
+        std::size_t bytes() const {
+            std::lock_guard<std::mutex> lock(m_);
+            return bytes_;
+        }
+
+        // tile products found and computed since the start
+        std::size_t hits() const {
+            return hits_;
+        }
+
+        std::size_t misses() const {
+            return misses_;
+        }
+
+    private:
+        struct key_hash {
+            std::size_t operator()(const key &k) const {
+                return digest_hash()(k.first) * 31 + digest_hash()(k.second);
+            }
+        };
+
+        typedef std::list<std::pair<key, std::shared_ptr<const Eigen::MatrixXi> > > lru_list;
+
+        std::size_t budget_;
+        mutable std::mutex m_;
+        lru_list lru_;
+        std::unordered_map<key, lru_list::iterator, key_hash> index_;
+        std::size_t bytes_;
+        std::atomic<std::size_t> hits_;
+        std::atomic<std::size_t> misses_;
+};
+
+// c = a * b tile by tile, taking every tile product the cache has and caching the ones it computes
+// all-zero tiles contribute nothing and are skipped; returns the number of tile products computed
+inline std::size_t tiledMultiply(const int_gemm &gemm, tile_cache &cache, int tile, const Eigen::Ref<const Eigen::MatrixXi> &a,
+                                 const Eigen::Ref<const Eigen::MatrixXi> &b, Eigen::MatrixXi &c) {
+    int m = a.rows();
+    int inner = a.cols();
+    int n = b.cols();
+    int ti = (m + tile - 1) / tile;
+    int tk = (inner + tile - 1) / tile;
+    int tj = (n + tile - 1) / tile;
+    auto span = [tile](int t, int total){
+        return std::min(tile, total - t * tile);
+    };
+    // digests of the tiles, and whether they are all zero
+    auto digestTiles = [&](const Eigen::Ref<const Eigen::MatrixXi> &x, int rows, int cols, std::vector<matrix_digest> &d, std::vector<bool> &zero){
+        d.resize(rows * cols);
+        zero.resize(rows * cols);
+        for (int r = 0; r < rows; r++)
+            for (int q = 0; q < cols; q++) {
+                int h = span(r, x.rows());
+                int w = span(q, x.cols());
+                d[r * cols + q] = digestBlock(x, r * tile, q * tile, h, w);
+                zero[r * cols + q] = !x.block(r * tile, q * tile, h, w).any();
+            }
+    };
+    std::vector<matrix_digest> da, db;
+    std::vector<bool> za, zb;
+    digestTiles(a, ti, tk, da, za);
+    if (b.data() == a.data() && b.rows() == a.rows() && b.cols() == a.cols()) {
+        // squaring, the tiles are the same
+        db = da;
+        zb = za;
+    } else
+        digestTiles(b, tk, tj, db, zb);
+    c.setZero(m, n);
+    Eigen::MatrixXi p;
+    std::size_t computed = 0;
+    for (int i = 0; i < ti; i++)
+        for (int j = 0; j < tj; j++) {
+            auto out = c.block(i * tile, j * tile, span(i, m), span(j, n));
+            for (int k = 0; k < tk; k++) {
+                if (za[i * tk + k] || zb[k * tj + j])
+                    continue;
+                tile_cache::key key(da[i * tk + k], db[k * tj + j]);
+                std::shared_ptr<const Eigen::MatrixXi> hit = cache.get(key);
+                if (!hit) {
+                    gemm.multiply(a.block(i * tile, k * tile, span(i, m), span(k, inner)), b.block(k * tile, j * tile, span(k, inner), span(j, n)), p);
+                    hit = std::make_shared<const Eigen::MatrixXi>(std::move(p));
+                    cache.put(key, hit);
+                    computed++;
+                }
+                // wraps around modulo 2^32 like the products themselves
+                out = (out.cast<unsigned>() + hit->cast<unsigned>()).cast<int>();
+            }
+        }
+    return computed;
+}
+
+} // namespace examples
+} // namespace ndn
+
+#endif // REUSE_EDGE_TILE_CACHE_HPP
@@ -0,0 +1,180 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2013-2018 Regents of the University of California.
+ *
+ * This file is part of ndn-cxx library (NDN C++ library with eXperimental eXtensions).
+ *
+ * ndn-cxx library is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later version.
+ *
+ * ndn-cxx library is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more details.
+ *
+ * You should have received copies of the GNU General Public License and GNU Lesser
+ * General Public License along with ndn-cxx, e.g., in COPYING.md file.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * See AUTHORS.md for complete list of ndn-cxx authors and contributors.
+ */
+
+#ifndef REUSE_EDGE_WORK_POOL_HPP
+#define REUSE_EDGE_WORK_POOL_HPP
+
+#include <cstddef>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace ndn {
+namespace examples {
+
+// bounded, work-stealing executor for compute tasks, shared by all the CN applications
+// one worker per core, each with its own deque: a worker pops the newest task of its own deque and, when that is
+// empty, steals the oldest task of another worker, so bursts of requests never oversubscribe the machine
+class work_pool {
+    public:
+        explicit work_pool(std::size_t workers = std::max(1u, std::thread::hardware_concurrency()))
+            : stop_(false), next_(0), pending_(0), idle_(0) {
+            for (std::size_t i = 0; i < workers; i++)
+                queues_.emplace_back(new worker_queue);
+            for (std::size_t i = 0; i < workers; i++)
+                threads_.emplace_back(&work_pool::workerLoop, this, i);
+        }
+
+        // lets the workers finish what is already queued, then joins them
+        ~work_pool() {
+            {
+                std::lock_guard<std::mutex> lk(sleep_m_);
+                stop_ = true;
+            }
+            cv_.notify_all();
+            for (auto &t : threads_)
+                t.join();
+        }
+
+        work_pool(const work_pool &) = delete;
+        work_pool &operator=(const work_pool &) = delete;
+
+        // queues a task; tasks submitted from a worker go to that worker's own deque, others are spread round-robin
+        void submit(std::function<void()> job) {
+            std::size_t i = tls_pool == this ? tls_index : next_++ % queues_.size();
+            {
+                // count the task before it becomes visible, so a thief never takes pending_ below zero
+                std::lock_guard<std::mutex> lk(sleep_m_);
+                pending_++;
+            }
+            {
+                std::lock_guard<std::mutex> lk(queues_[i]->m);
+                queues_[i]->q.push_back(std::move(job));
+            }
+            cv_.notify_one();
+        }
+
+        // queues task and calls done with its result on the same worker as soon as it returns
+        template <typename Task, typename Done>
+        void submit(Task task, Done done) {
+            submit(std::function<void()>([task = std::move(task), done = std::move(done)]() mutable {
+                done(task());
+            }));
+        }
+
+        std::size_t size() const {
+            return threads_.size();
+        }
+
+        // tasks queued but not picked up by a worker yet
+        std::size_t pending() const {
+            return pending_;
+        }
+
+        // workers currently waiting for something to do
+        std::size_t idle() const {
+            return idle_;
+        }
+
+    private:
+        struct worker_queue {
+            std::mutex m;
+            std::deque<std::function<void()> > q;
+        };
+
+        bool popOwn(std::size_t i, std::function<void()> &job) {
+            std::lock_guard<std::mutex> lk(queues_[i]->m);
+            if (queues_[i]->q.empty())
+                return false;
+            job = std::move(queues_[i]->q.back());
+            queues_[i]->q.pop_back();
+            return true;
+        }
+
+        bool steal(std::size_t i, std::function<void()> &job) {
+            for (std::size_t k = 1; k < queues_.size(); k++) {
+                worker_queue &victim = *queues_[(i + k) % queues_.size()];
+                std::lock_guard<std::mutex> lk(victim.m);
+                if (!victim.q.empty()) {
+                    job = std::move(victim.q.front());
+                    victim.q.pop_front();
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        void workerLoop(std::size_t i) {
+            tls_pool = this;
+            tls_index = i;
+            std::function<void()> job;
+            for (;;) {
+                if (popOwn(i, job) || steal(i, job)) {
+                    pending_--;
+                    try {
+                        job();
+                    } catch (const std::exception &e) {
+                        // a failing task must not take the worker down with it
+                        std::cerr << "ERROR: task failed: " << e.what() << std::endl;
+                    } catch (...) {
+                        // nor one that throws something else
+                        std::cerr << "ERROR: task failed with an unknown exception" << std::endl;
+                    }
+                    job = nullptr;
+                    continue;
+                }
+                std::unique_lock<std::mutex> lk(sleep_m_);
+                if (stop_ && !pending_)
+                    return;
+                idle_++;
+                cv_.wait(lk, [&]{
+                    return stop_ || pending_ > 0;
+                });
+                idle_--;
+            }
+        }
+
+        std::vector<std::unique_ptr<worker_queue> > queues_;
+        std::vector<std::thread> threads_;
+        std::mutex sleep_m_;
+        std::condition_variable cv_;
+        bool stop_;
+        std::atomic<std::size_t> next_;
+        std::atomic<std::size_t> pending_;
+        std::atomic<std::size_t> idle_;
+
+        // which pool and worker the current thread belongs to, if any
+        static inline thread_local work_pool *tls_pool = nullptr;
+        static inline thread_local std::size_t tls_index = 0;
+};
+
+} // namespace examples
+} // namespace ndn
+
+#endif // REUSE_EDGE_WORK_POOL_HPP
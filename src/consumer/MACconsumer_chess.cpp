@@ -29,6 +29,8 @@
 #include <chrono>
 #include <thread>
 #include <fstream>
+#include <mutex>
+#include <condition_variable>
 
 #include "chesstest.hpp"
 
@@ -62,6 +64,7 @@ class Consumer : noncopyable {
               numinter(std::ceil(static_cast<double>(d_) / static_cast<int>(APP_OCTET_LIM / (d_ * 4)))),
               lifetime(0),
               flag(false),
+              done(false),
               filename(fn, std::ofstream::out | std::ofstream::app),
               use_file(false) {}
 
@@ -72,6 +75,7 @@ class Consumer : noncopyable {
               numinter(std::ceil(static_cast<double>(d_) / static_cast<int>(APP_OCTET_LIM / (d_ * 4)))),
               lifetime(0),
               flag(false),
+              done(false),
               filename(fn, std::ofstream::out | std::ofstream::app),
               use_file(true),
               infile(ifn),
@@ -93,6 +97,20 @@ class Consumer : noncopyable {
             }
             intereststr += "/" + fen;
             engine.receive_quit();
+
+            // start producer listener face, the CN tells us through it when our result is ready
+            std::thread prodlistener([&](){
+                m_face_prod.setInterestFilter("/edge-compute/requester",
+                                              bind(&Consumer::onInterest, this, _1, _2),
+                                              RegisterPrefixSuccessCallback(),
+                                              bind(&Consumer::onRegisterFailed, this, _1, _2));
+                m_face_prod.processEvents();
+            });
+            // runs in background forever
+            prodlistener.detach();
+
+            // init time for NFD (important)
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
  
             // create initial
             Name n(intereststr);
@@ -114,7 +132,14 @@ class Consumer : noncopyable {
 
             // loop over CTTs until receive the result
             while (!flag) {
-                std::this_thread::sleep_for(std::chrono::milliseconds(lifetime));
+                {
+                    // sleep for the CTT, unless the CN tells us sooner that the result is ready
+                    std::unique_lock<std::mutex> done_lock(done_m);
+                    done_cv.wait_for(done_lock, std::chrono::milliseconds(lifetime), [&]{
+                        return done;
+                    });
+                    done = false;
+                }
                 // re-express
                 Interest rinterest(Name(intereststr).appendVersion());
                 rinterest.setInterestLifetime(30_s);
@@ -152,14 +177,50 @@ class Consumer : noncopyable {
         void onTimeout(const Interest& interest) {
             std::cerr << "Timeout " << interest << std::endl;
         }
+
+        void onInterest(const InterestFilter &filter, const Interest &interest) {
+            std::cout << "received interest " << interest << std::endl;
+
+            std::string s(interest.getName().toUri());
+            int start = nthOccurrence(s, "/", 4) + 1;
+            std::string op = s.substr(start, nthOccurrence(s, "/", 5) - start);
+            // the CN only ever asks us for completion notifications
+            if (op != "done")
+                return;
+            // the CN finished our task; acknowledge it and cut the current CTT sleep short
+            Data ack(interest.getName());
+            ack.setFreshnessPeriod(1_s);
+            // create default signature (not used but required by ndn-cxx)
+            Signature signature;
+            SignatureInfo signatureInfo(static_cast<tlv::SignatureTypeValue>(255));
+            signature.setInfo(signatureInfo);
+            signature.setValue(makeNonNegativeIntegerBlock(tlv::SignatureValue, 0));
+            ack.setSignature(signature);
+            m_face_prod.put(ack);
+            std::lock_guard<std::mutex> done_lock(done_m);
+            done = true;
+            done_cv.notify_one();
+        }
+
+        void onRegisterFailed(const Name &prefix, const std::string &reason) {
+            std::cerr << "ERROR: Failed to register prefix \""
+                      << prefix << "\" in local hub's daemon (" << reason << ")"
+                      << std::endl;
+            m_face_prod.shutdown();
+        }
     
     private:
         Face m_face;
+        Face m_face_prod;
         double p_;
         int d_;
         int numinter;
         int lifetime;
         bool flag;
+        // set by the CN's completion notification, guarded by done_m
+        bool done;
+        std::mutex done_m;
+        std::condition_variable done_cv;
         std::string intereststr;
         std::ofstream filename;
         bool use_file;
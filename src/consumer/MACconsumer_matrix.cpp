@@ -23,6 +23,8 @@
 
 
 #include <ndn-cxx/face.hpp>
+#include <ndn-cxx/util/sha256.hpp>
+#include <ndn-cxx/util/string-helper.hpp>
 
 #include <iostream>
 #include <cstring>
@@ -35,6 +37,15 @@
 #include <atomic>
 #include <fstream>
 #include <functional>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <vector>
+#include <algorithm>
+#include <condition_variable>
+
+#include "matrix_canon.hpp"
+#include "matrix_wire.hpp"
 
 #define APP_OCTET_LIM (MAX_NDN_PACKET_SIZE - 400)
 
@@ -59,7 +70,22 @@ namespace examples {
 
 class Consumer : noncopyable {
     public:
-        Consumer(int id, int d, int e, int mc, const std::string &fn, bool uc) : d_(d), e_(e), use_cache(uc), numinter(std::ceil(static_cast<double>(d_) / static_cast<int>(APP_OCTET_LIM / (d_ * 4)))), packets(numinter, make_shared<Data>()), packiter(packets.begin()), mc_(mc), lifetime(0), flag(false), prodreceived(0), intereststr("/edge-compute/computer/" + std::to_string(id) + "/multiply/" + std::to_string(d_) + "/" + std::to_string(e_)), filename(fn, std::ofstream::out | std::ofstream::app), send(true) {}
+        Consumer(int id, int d, int e, int mc, const std::string &fn, bool uc, const std::vector<int> &chain) : d_(d), e_(e), use_cache(uc), chain_(chain), numinter(std::ceil(static_cast<double>(d_) / static_cast<int>(APP_OCTET_LIM / (d_ * 4)))), packets(numinter, make_shared<Data>()), packiter(packets.begin()), mc_(mc), lifetime(0), flag(false), prodreceived(0), intereststr("/edge-compute/computer/" + std::to_string(id) + "/multiply/" + std::to_string(d_) + "/" + std::to_string(e_)), filename(fn, std::ofstream::out | std::ofstream::app), send(true), done(false) {
+            if (!chain_.empty()) {
+                // chain of matrices instead of a power: operand k is chain_[k] x chain_[k + 1], filled with mc + k
+                for (std::size_t k = 0; k < chain_.size(); k++)
+                    chain_dims += (k ? "," : "") + std::to_string(chain_[k]);
+                intereststr = "/edge-compute/computer/" + std::to_string(id) + "/chain/" + chain_dims;
+                for (std::size_t k = 0; k + 1 < chain_.size(); k++) {
+                    Eigen::MatrixXi op = Eigen::MatrixXi::Constant(chain_[k], chain_[k + 1], mc + k);
+                    std::string digest = digestMatrix(op);
+                    intereststr += "/" + digest;
+                    operands.emplace(digest, std::move(op));
+                }
+                // the CN asks for whichever operands it lacks on its own, so there is nothing to wait for
+                send = false;
+            }
+        }
     
         void run() {
             // start producer listener face
@@ -77,11 +103,20 @@ class Consumer : noncopyable {
             std::this_thread::sleep_for(std::chrono::milliseconds(100));
 
             // create matrix based on parameters
-            constructMatrix();
+            if (chain_.empty())
+                constructMatrix();
             // if enabling reuse,
-            if (use_cache)
-                // enable hashing of the matrix at the CN to avoid resends
-                intereststr += "/" + std::to_string(std::hash<std::string>()(content));
+            if (use_cache && chain_.empty()) {
+                // send the canonical form instead, so every scalar multiple and the transpose of the matrix share the CN's
+                // cached powers, and name the transform back to ours after its digest
+                canonical_form cf = canonicalize(mat);
+                mat.swap(cf.mat);
+                std::ostringstream pl;
+                pl << mat.format(PayloadFmt);
+                content = pl.str();
+                // enable lookup of the matrix by digest at the CN to avoid resends
+                intereststr += "/" + digestMatrix(mat) + "/" + std::to_string(cf.params.scale) + "/" + (cf.params.transposed ? "1" : "0") + "/" + structureName(cf.params.structure);
+            }
 
             // create initial
             Name n(intereststr);
@@ -118,7 +153,14 @@ class Consumer : noncopyable {
 
             // loop over CTTs until receive the result
             while (!flag) {
-                std::this_thread::sleep_for(std::chrono::milliseconds(lifetime));
+                {
+                    // sleep for the CTT, unless the CN tells us sooner that the result is ready
+                    std::unique_lock<std::mutex> done_lock(done_m);
+                    done_cv.wait_for(done_lock, std::chrono::milliseconds(lifetime), [&]{
+                        return done;
+                    });
+                    done = false;
+                }
                 // re-express
                 Interest rinterest(Name(intereststr).appendVersion());
                 rinterest.setInterestLifetime(30_s);
@@ -132,7 +174,10 @@ class Consumer : noncopyable {
             }
             auto diff = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
             // end timer, log in file
-            filename << d_ << ' ' << e_ << ' ' << (diff / 1000) << "ms" << std::endl;
+            if (chain_.empty())
+                filename << d_ << ' ' << e_ << ' ' << (diff / 1000) << "ms" << std::endl;
+            else
+                filename << "chain " << chain_dims << ' ' << (diff / 1000) << "ms" << std::endl;
         }
     
     private:
@@ -163,15 +208,25 @@ class Consumer : noncopyable {
     
         void constructMatrix() {
             // create d_ x d_ square matrix filled with mc_
-            Eigen::MatrixXi mat(Eigen::MatrixXi::NullaryExpr(d_, d_, [&](){
+            mat = Eigen::MatrixXi::NullaryExpr(d_, d_, [&](){
                 return mc_;
-            }));
+            });
             std::ostringstream pl;
             // stringify it
             pl << mat.format(PayloadFmt);
             content = pl.str();
         }
 
+        // content digest the CN keys its reuse table by: SHA-256 over the shape (two little-endian uint32) and raw int32 data, in hex
+        static std::string digestMatrix(const Eigen::MatrixXi &mat) {
+            util::Sha256 sha;
+            uint32_t shape[2] = {static_cast<uint32_t>(mat.rows()), static_cast<uint32_t>(mat.cols())};
+            sha.update(reinterpret_cast<const uint8_t *>(shape), sizeof(shape));
+            sha.update(reinterpret_cast<const uint8_t *>(mat.data()), mat.size() * sizeof(int));
+            ConstBufferPtr d = sha.computeDigest();
+            return toHex(d->data(), d->size(), false);
+        }
+
         void onInterest(const InterestFilter &filter, const Interest &interest) {
             std::cout << "received interest " << interest << std::endl;
 
@@ -181,17 +236,52 @@ class Consumer : noncopyable {
             std::string s(oss.str());
             int start = nthOccurrence(s, "/", 4) + 1;
             std::string op = s.substr(start, nthOccurrence(s, "/", 5) - start);
+
+            if (op == "done") {
+                // completion notification, not a request for part of the matrix
+                onDone(interest);
+                return;
+            }
     
-            if (op == "matrix") {
+            if (op == "operand") {
+                // part of one of the chain's operands: /operand/<digest>/<begrow>/<endrow>/...
+                start = nthOccurrence(s, "/", 5) + 1;
+                int end = nthOccurrence(s, "/", 6);
+                auto it = operands.find(s.substr(start, end - start));
+                if (it == operands.end()) {
+                    std::cerr << "CN asked for an operand we don't have: " << s << std::endl;
+                    return;
+                }
+                start = end + 1;
+                end = nthOccurrence(s, "/", 7);
+                int begrow = std::min(std::stoi(s.substr(start, end - start)), static_cast<int>(it->second.rows()));
+                int endrow = std::min(std::stoi(s.substr(end + 1)), static_cast<int>(it->second.rows()));
+                std::string portion(encodeSegment(it->second, begrow, std::max(begrow, endrow), s.find("/" WIRE_SPARSE_COMPONENT "/") != std::string::npos));
+                (*packiter)->setName(dataName);
+                (*packiter)->setFreshnessPeriod(10_s);
+                (*packiter)->setContent(reinterpret_cast<const uint8_t *>(portion.data()), portion.size());
+                m_face_prod.put(*(*packiter));
+                if (++packiter == packets.end())
+                    packiter = packets.begin();
+            } else if (op == "matrix") {
                 start = nthOccurrence(s, "/", 5) + 1;
                 int end = nthOccurrence(s, "/", 6);
-                // block of rows: [begrow, endrow)
-                int begrow = std::stoi(s.substr(start, end - start)) == 0 ? 0 : (nthOccurrence(content, "|", std::stoi(s.substr(start, end - start))) + 1);
-                int endrow = nthOccurrence(content, "|", std::stoi(s.substr(end + 1)));
-                if (endrow == std::string::npos)
-                    endrow = content.size() - 1;
-                // get specific part of the matrix based on begrow and endrow
-                std::string portion(content.substr(begrow, endrow - begrow + 1));
+                std::string portion;
+                if (s.find("/" WIRE_BINARY_COMPONENT "/") != std::string::npos) {
+                    // the CN takes binary segments, so send rows [begrow, endrow) without stringifying them
+                    int begrow = std::min(std::stoi(s.substr(start, end - start)), d_);
+                    int endrow = std::min(std::stoi(s.substr(end + 1)), d_);
+                    // (sparse rows too, if the CN says it decodes them)
+                    portion = encodeSegment(mat, begrow, std::max(begrow, endrow), s.find("/" WIRE_SPARSE_COMPONENT "/") != std::string::npos);
+                } else {
+                    // block of rows: [begrow, endrow)
+                    int begrow = std::stoi(s.substr(start, end - start)) == 0 ? 0 : (nthOccurrence(content, "|", std::stoi(s.substr(start, end - start))) + 1);
+                    int endrow = nthOccurrence(content, "|", std::stoi(s.substr(end + 1)));
+                    if (endrow == std::string::npos)
+                        endrow = content.size() - 1;
+                    // get specific part of the matrix based on begrow and endrow
+                    portion = content.substr(begrow, endrow - begrow + 1);
+                }
 
                 (*packiter)->setName(dataName);
                 (*packiter)->setFreshnessPeriod(10_s);
@@ -199,14 +289,31 @@ class Consumer : noncopyable {
                 std::cout << "sending data " << *(*packiter) << std::endl;
                 // send data
                 m_face_prod.put(*(*packiter));
-                // go to next pre-signed packet
-                ++packiter;
+                // go to next pre-signed packet (retransmitted interests wrap around instead of running off the end)
+                if (++packiter == packets.end())
+                    packiter = packets.begin();
             }
             // increment global counter
             prodreceived++;
             std::cout << "Number of interests received: " << prodreceived << std::endl;
         }
     
+        // the CN finished our task and told us so; acknowledge it and cut the current CTT sleep short
+        void onDone(const Interest &interest) {
+            Data ack(interest.getName());
+            ack.setFreshnessPeriod(1_s);
+            // create default signature (not used but required by ndn-cxx)
+            Signature signature;
+            SignatureInfo signatureInfo(static_cast<tlv::SignatureTypeValue>(255));
+            signature.setInfo(signatureInfo);
+            signature.setValue(makeNonNegativeIntegerBlock(tlv::SignatureValue, 0));
+            ack.setSignature(signature);
+            m_face_prod.put(ack);
+            std::lock_guard<std::mutex> done_lock(done_m);
+            done = true;
+            done_cv.notify_one();
+        }
+
         void onRegisterFailed(const Name &prefix, const std::string &reason) {
             std::cerr << "ERROR: Failed to register prefix \""
                       << prefix << "\" in local hub's daemon (" << reason << ")"
@@ -220,6 +327,11 @@ class Consumer : noncopyable {
         int d_;
         int e_;
         bool use_cache;
+        // p0..pn of a chain request, empty for a power
+        std::vector<int> chain_;
+        std::string chain_dims;
+        // operands of the chain by hex digest
+        std::map<std::string, Eigen::MatrixXi> operands;
         int numinter;
         std::vector<shared_ptr<Data> > packets;
         std::vector<shared_ptr<Data> >::iterator packiter;
@@ -229,9 +341,14 @@ class Consumer : noncopyable {
         std::atomic<int> prodreceived;
         std::string intereststr;
         static const Eigen::IOFormat PayloadFmt;
+        Eigen::MatrixXi mat;
         std::string content;
         std::ofstream filename;
         bool send;
+        // set by the CN's completion notification, guarded by done_m
+        bool done;
+        std::mutex done_m;
+        std::condition_variable done_cv;
 };
 
 const Eigen::IOFormat Consumer::PayloadFmt(0, Eigen::DontAlignCols, ",", "|", "", "", "", "|");
@@ -240,11 +357,24 @@ const Eigen::IOFormat Consumer::PayloadFmt(0, Eigen::DontAlignCols, ",", "|", ""
 } // namespace ndn
 
 int main(int argc, char** argv) {
-    if (argc != 7) {
-        std::cerr << "usage: ./MACconsumer_matrix <ID> <Dimensions of Matrix> <Exponent> <Matrix Code> <File Name> <Use Cache?>" << std::endl;
+    std::vector<int> chain;
+    bool usage = argc != 7 && argc != 8;
+    if (argc == 8) {
+        // --chain=p0,p1,...,pn multiplies n matrices instead of raising one to the exponent
+        std::string arg(argv[7]);
+        if (arg.compare(0, 8, "--chain=") == 0) {
+            std::istringstream dims(arg.substr(8));
+            std::string p;
+            while (std::getline(dims, p, ','))
+                chain.push_back(std::atoi(p.c_str()));
+        }
+        usage = chain.size() < 2 || *std::min_element(chain.begin(), chain.end()) <= 0;
+    }
+    if (usage) {
+        std::cerr << "usage: ./MACconsumer_matrix <ID> <Dimensions of Matrix> <Exponent> <Matrix Code> <File Name> <Use Cache?> [--chain=<p0>,<p1>,...,<pn>]" << std::endl;
         return 1;
     }
-    ndn::examples::Consumer consumer(std::atoi(argv[1]), std::atoi(argv[2]), std::atoi(argv[3]), std::atoi(argv[4]), std::string(argv[5]), std::atoi(argv[6]));
+    ndn::examples::Consumer consumer(std::atoi(argv[1]), std::atoi(argv[2]), std::atoi(argv[3]), std::atoi(argv[4]), std::string(argv[5]), std::atoi(argv[6]), chain);
     try {
         consumer.run();
     } catch (const std::exception& e) {
@@ -37,6 +37,7 @@
 #include <dlib/image_processing/frontal_face_detector.h>
 #include <dlib/image_io.h>
 #include <condition_variable>
+#include <mutex>
 
 #define APP_OCTET_LIM (MAX_NDN_PACKET_SIZE - 400)
 
@@ -61,12 +62,16 @@ namespace examples {
 
 class Consumer : noncopyable {
     public:
-        Consumer(int id, double o, int w, const std::string &imn, const std::string &fn)
+        Consumer(int id, double o, int w, const std::string &imn, const std::string &fn, bool delta)
             : o_(o),
               w_(w),
+              sw_(0),
               imn_(imn),
+              use_delta(delta),
+              delta_(false),
               lifetime(0),
               flag(false),
+              done(false),
               intereststr("/edge-compute/computer/" + std::to_string(id) + "/detectfaces/" + std::to_string(o_)),
               filename(fn, std::ofstream::out | std::ofstream::app) {}
     
@@ -112,11 +117,18 @@ class Consumer : noncopyable {
             dlib::assign_image(subimg, dlib::sub_image(img, dlib::rectangle(w_, img.nr())));
             std::size_t offset_f = 1;
             const std::size_t move = w_ * (1 - o_);
+            // one past the last column of the image the previous snapshot covered
+            std::size_t prev_end = w_;
             // loop over all snapshots
             while (subimg.nc() > 0) {
                 content = std::basic_string<unsigned char>(subimg.begin(), subimg.end());
                 // get content string from sub-image
 
+                {
+                    // a late notification for the previous snapshot must not cut this one's first sleep short
+                    std::lock_guard<std::mutex> done_lock(done_m);
+                    done = false;
+                }
                 // create initial
                 Name n(specintereststr);
                 Interest interest(n.appendVersion());
@@ -138,14 +150,19 @@ class Consumer : noncopyable {
                 // wait until all packets are filled with data using bool as indicator, i.e. wait for all the interests for data to come in and to be filled
                 // smarter than the prodreceived method
                 cond.wait(locker, [&]{
-                    return std::all_of(packets.begin(), packets.end(), [](const std::pair<bool, shared_ptr<Data> > &p){
-                        return p.first;
-                    });
+                    return allSent();
                 });
 
                 // loop over CTTs until receive the result
                 while (!flag) {
-                    std::this_thread::sleep_for(std::chrono::milliseconds(lifetime));
+                    {
+                    // sleep for the CTT, unless the CN tells us sooner that the result is ready
+                    std::unique_lock<std::mutex> done_lock(done_m);
+                    done_cv.wait_for(done_lock, std::chrono::milliseconds(lifetime), [&]{
+                        return done;
+                    });
+                    done = false;
+                }
                     // re-express
                     Interest rinterest(Name(specintereststr).appendVersion());
                     rinterest.setInterestLifetime(30_s);
@@ -177,6 +194,32 @@ class Consumer : noncopyable {
                 std::transform(packets.begin(), packets.end(), packets.begin(), [](const std::pair<bool, shared_ptr<Data> > &p){
                     return std::make_pair(false, std::move(p.second));
                 });
+                // the CN already holds everything this snapshot shares with the last one, so offer it just the columns it adds
+                // (it may still ask for the whole snapshot, e.g. if it lost the last one)
+                std::size_t beg = (offset_f - 1) * move;
+                delta_ = use_delta && subimg.nc() > 0 && beg < prev_end;
+                if (!delta_ && subimg.nc() > 0 && beg < prev_end)
+                    // the CN still reuses what it computed for the last snapshot, so it needs the step either way
+                    specintereststr += "/step/" + std::to_string(move);
+                if (delta_) {
+                    specintereststr += "/delta/" + std::to_string(move);
+                    sw_ = beg + w_ - prev_end;
+                    strip.clear();
+                    if (sw_)
+                        for (long r = 0; r < img.nr(); r++)
+                            strip.append(&img[r][prev_end], sw_);
+                    int strips = sw_ ? std::ceil(static_cast<double>(img.nr()) / static_cast<int>(APP_OCTET_LIM / sw_)) : 0;
+                    strip_packets.resize(strips);
+                    // reset bools, pre-signing the packets this many strips didn't need before
+                    for (auto &p : strip_packets) {
+                        p.first = false;
+                        if (!p.second) {
+                            p.second = make_shared<Data>();
+                            p.second->setSignature(signature);
+                        }
+                    }
+                }
+                prev_end = beg + w_;
             }
             // if a floating point error is raised at the end, it's okay
             // everything has completed correctly
@@ -215,38 +258,79 @@ class Consumer : noncopyable {
             std::string op = s.substr(start, nthOccurrence(s, "/", 5) - start);
             int end;
             int snum;
+
+            if (op == "done") {
+                // completion notification, not a request for part of the snapshot
+                onDone(interest);
+                return;
+            }
     
             if (op == "detectfaces") {
                 start = nthOccurrence(s, "/", 5) + 1;
                 end = nthOccurrence(s, "/", 6);
+                // rows of the new strip rather than of the whole snapshot
+                bool delta = s.substr(start, end - start) == "delta";
+                if (delta) {
+                    start = end + 1;
+                    end = nthOccurrence(s, "/", 7);
+                }
                 // block of rows: [begrow, endrow)
                 int begrow = std::stoi(s.substr(start, end - start));
                 int endrow = std::stoi(s.substr(end + 1));
                 // packet number for array
                 snum = begrow / (endrow - begrow);
+                std::vector<std::pair<bool, shared_ptr<Data> > > &sent = delta ? strip_packets : packets;
+                const std::basic_string<unsigned char> &source = delta ? strip : content;
+                std::size_t width = delta ? sw_ : w_;
+                if (snum >= static_cast<int>(sent.size()) || (delta && !delta_)) {
+                    std::cerr << "no such part " << s << std::endl;
+                    return;
+                }
                 // get specific part of the image based on begrow and endrow
-                std::basic_string<unsigned char> portion(content.substr(begrow * w_, endrow * w_ - begrow * w_));
+                std::basic_string<unsigned char> portion(source.substr(begrow * width, endrow * width - begrow * width));
 
                 // set the bool
-                if (!packets[snum].first)
-                    packets[snum].first = true;
-                packets[snum].second->setName(dataName);
-                packets[snum].second->setFreshnessPeriod(10_s);
-                packets[snum].second->setContent(reinterpret_cast<const unsigned char *>(portion.data()), portion.size());
-                std::cout << "sending data " << *(packets[snum].second) << std::endl;
+                if (!sent[snum].first)
+                    sent[snum].first = true;
+                sent[snum].second->setName(dataName);
+                sent[snum].second->setFreshnessPeriod(10_s);
+                sent[snum].second->setContent(reinterpret_cast<const unsigned char *>(portion.data()), portion.size());
+                std::cout << "sending data " << *(sent[snum].second) << std::endl;
                 // send data
-                m_face_prod.put(*(packets[snum].second));
+                m_face_prod.put(*(sent[snum].second));
             }
             // check whether all the interests have been replied to by checking bools for true
-            if (std::all_of(packets.begin(), packets.end(), [](const std::pair<bool, shared_ptr<Data> > &p){
-                return p.first;
-            })) {
+            if (allSent()) {
                 // notify waiting thread so it can move on for waiting for CTTs
                 std::lock_guard<std::mutex> locker(mu);
                 cond.notify_one();
             }
         }
     
+        // whether the CN has every part of the current snapshot, in whichever form it asked for it
+        bool allSent() const {
+            auto sent = [](const std::pair<bool, shared_ptr<Data> > &p){
+                return p.first;
+            };
+            return std::all_of(packets.begin(), packets.end(), sent) || (delta_ && std::all_of(strip_packets.begin(), strip_packets.end(), sent));
+        }
+
+        // the CN finished our task and told us so; acknowledge it and cut the current CTT sleep short
+        void onDone(const Interest &interest) {
+            Data ack(interest.getName());
+            ack.setFreshnessPeriod(1_s);
+            // create default signature (not used but required by ndn-cxx)
+            Signature signature;
+            SignatureInfo signatureInfo(static_cast<tlv::SignatureTypeValue>(255));
+            signature.setInfo(signatureInfo);
+            signature.setValue(makeNonNegativeIntegerBlock(tlv::SignatureValue, 0));
+            ack.setSignature(signature);
+            m_face_prod.put(ack);
+            std::lock_guard<std::mutex> done_lock(done_m);
+            done = true;
+            done_cv.notify_one();
+        }
+
         void onRegisterFailed(const Name &prefix, const std::string &reason) {
             std::cerr << "ERROR: Failed to register prefix \""
                       << prefix << "\" in local hub's daemon (" << reason << ")"
@@ -259,16 +343,29 @@ class Consumer : noncopyable {
         Face m_face_prod;
         double o_;
         std::size_t w_;
+        // width of the new strip of a delta snapshot
+        std::size_t sw_;
         std::string imn_;
         bool use_cache;
+        // offer the CN only the new columns of each snapshot after the first, and whether the current one does
+        bool use_delta;
+        bool delta_;
         int numinter;
         std::vector<std::pair<bool, shared_ptr<Data> > > packets;
+        // the same for the parts of the new strip
+        std::vector<std::pair<bool, shared_ptr<Data> > > strip_packets;
         std::mutex mu;
         std::condition_variable cond;
         int lifetime;
         bool flag;
+        // set by the CN's completion notification, guarded by done_m
+        bool done;
+        std::mutex done_m;
+        std::condition_variable done_cv;
         std::string intereststr;
         std::basic_string<unsigned char> content;
+        // the columns of the current snapshot that the last one didn't have, row by row
+        std::basic_string<unsigned char> strip;
         std::ofstream filename;
 };
 
@@ -276,11 +373,11 @@ class Consumer : noncopyable {
 } // namespace ndn
 
 int main(int argc, char** argv) {
-    if (argc != 6) {
-        std::cerr << "usage: ./MACconsumer_simcamera <ID> <Overlap Fraction> <Width of Sub-image> <Image> <File Name>" << std::endl;
+    if (argc != 6 && !(argc == 7 && std::string(argv[6]) == "--no-delta")) {
+        std::cerr << "usage: ./MACconsumer_simcamera <ID> <Overlap Fraction> <Width of Sub-image> <Image> <File Name> [--no-delta]" << std::endl;
         return 1;
     }
-    ndn::examples::Consumer consumer(std::atoi(argv[1]), std::atof(argv[2]), std::atoi(argv[3]), std::string(argv[4]), std::string(argv[5]));
+    ndn::examples::Consumer consumer(std::atoi(argv[1]), std::atof(argv[2]), std::atoi(argv[3]), std::string(argv[4]), std::string(argv[5]), argc == 6);
     try {
         consumer.run();
     } catch (const std::exception& e) {